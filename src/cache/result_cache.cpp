@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <format>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include "cache/result_cache.hpp"
+#include "exceptions.hpp"
+#include "util/hash.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+    constexpr std::chrono::steady_clock::duration flush_interval = std::chrono::seconds(1);
+}
+
+ResultCache::ResultCache(fs::path directory, uint64_t max_bytes)
+    : directory(std::move(directory))
+    , max_bytes(max_bytes)
+    , last_flush(std::chrono::steady_clock::now().time_since_epoch().count()) {
+    fs::create_directories(this->directory);
+    flush();
+}
+
+ResultCache::~ResultCache() {
+    try {
+        flush();
+    } catch (std::exception &) {
+        // counters are best effort
+    }
+}
+
+std::string ResultCache::key(std::span<const char> input, const std::string & operation) {
+    xxhash64 content;
+    content.update(input.data(), input.size());
+    xxhash64 op;
+    op.update(operation);
+    return std::format("{:016x}{:016x}", content.digest(), op.digest());
+}
+
+fs::path ResultCache::entry_path(const std::string & key) {
+    return directory / (key + ".bmp");
+}
+
+template<typename F>
+void ResultCache::with_stats(F f) {
+    fs::path path = directory / "stats";
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw invalid_file_path(path.c_str());
+    }
+    flock(fd, LOCK_EX);
+
+    CacheStats stats;
+    char text[128] = {};
+    ssize_t n = pread(fd, text, sizeof(text) - 1, 0);
+    if (n > 0) {
+        unsigned long long hits = 0, misses = 0, bytes = 0;
+        std::sscanf(text, "hits %llu misses %llu bytes %llu", &hits, &misses, &bytes);
+        stats = {hits, misses, bytes};
+    }
+
+    f(stats);
+
+    std::string updated = std::format("hits {} misses {} bytes {}\n", stats.hits, stats.misses, stats.bytes);
+    if (pwrite(fd, updated.data(), updated.size(), 0) == static_cast<ssize_t>(updated.size())) {
+        ftruncate(fd, static_cast<off_t>(updated.size()));
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+bool ResultCache::fetch(const std::string & key, const char * output_path) {
+    fs::path entry = entry_path(key);
+    std::error_code error;
+
+    // copy rather than hard link: the next write to output_path would truncate the cached inode.
+    // copy_file goes through copy_file_range/sendfile, so the data never enters user space
+    bool hit = fs::copy_file(entry, output_path, fs::copy_options::overwrite_existing, error);
+    if (hit) {
+        fs::last_write_time(entry, fs::file_time_type::clock::now(), error); // lru order
+    }
+
+    (hit ? unflushed_hits : unflushed_misses)++;
+    maybe_flush();
+    return hit;
+}
+
+void ResultCache::store(const std::string & key, const char * output_path) {
+    fs::path entry = entry_path(key);
+    fs::path temporary = directory / std::format("{}.{}.{}.tmp", key, getpid(), std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+    std::error_code error;
+    if (!fs::copy_file(output_path, temporary, fs::copy_options::overwrite_existing, error)) {
+        return; // caching is best effort
+    }
+    uintmax_t size = fs::file_size(temporary, error);
+    bool replaced = fs::exists(entry, error);
+    fs::rename(temporary, entry, error);
+    if (error) {
+        fs::remove(temporary, error);
+        return;
+    }
+
+    if (!replaced) {
+        unflushed_bytes += static_cast<int64_t>(size);
+    }
+    maybe_flush();
+}
+
+CacheStats ResultCache::flush() {
+    CacheStats result;
+    with_stats([&](CacheStats & stats) {
+        stats.hits += unflushed_hits.exchange(0);
+        stats.misses += unflushed_misses.exchange(0);
+        int64_t bytes = static_cast<int64_t>(stats.bytes) + unflushed_bytes.exchange(0);
+        stats.bytes = bytes > 0 ? static_cast<uint64_t>(bytes) : 0;
+        if (stats.bytes > max_bytes) {
+            evict(stats);
+        }
+        flushed_bytes = stats.bytes;
+        result = stats;
+    });
+    return result;
+}
+
+// one caller per interval wins the exchange and takes the file lock, the rest only count
+void ResultCache::maybe_flush() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+    auto last = last_flush.load();
+    bool due = now - last >= flush_interval.count();
+    bool full = static_cast<int64_t>(flushed_bytes) + unflushed_bytes > static_cast<int64_t>(max_bytes);
+    if ((due || full) && last_flush.compare_exchange_strong(last, now)) {
+        flush();
+    }
+}
+
+// called with the counters locked
+void ResultCache::evict(CacheStats & stats) {
+    struct Entry {
+        fs::path path;
+        fs::file_time_type used;
+        uintmax_t size;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    std::error_code error;
+    for (const auto & file : fs::directory_iterator(directory, error)) {
+        if (file.path().extension() != ".bmp") {
+            continue;
+        }
+        Entry e {file.path(), file.last_write_time(error), file.file_size(error)};
+        if (!error) {
+            entries.push_back(e);
+            total += e.size;
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry & a, const Entry & b) {
+        return a.used < b.used;
+    });
+
+    // evict down to 90% so the scan does not run on every store
+    uint64_t target = max_bytes - max_bytes / 10;
+    for (const auto & e : entries) {
+        if (total <= target) {
+            break;
+        }
+        if (fs::remove(e.path, error)) {
+            total -= e.size;
+        }
+    }
+    stats.bytes = total;
+}
+
+CacheStats ResultCache::stats() {
+    return flush();
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t bytes = 0;
+};
+
+// on-disk cache of command outputs keyed by input content and normalized operation.
+// entries are evicted least recently used first once the directory grows past max_bytes.
+// counters live in the directory so every process sharing it sees the same numbers;
+// each process counts in memory and merges into the file at most once a second and on exit,
+// or sooner when the directory may have grown past max_bytes.
+class ResultCache {
+    std::filesystem::path directory;
+    uint64_t max_bytes;
+
+    std::atomic<uint64_t> unflushed_hits = 0;
+    std::atomic<uint64_t> unflushed_misses = 0;
+    std::atomic<int64_t> unflushed_bytes = 0;
+    // directory size as of the last flush
+    std::atomic<uint64_t> flushed_bytes = 0;
+    std::atomic<std::chrono::steady_clock::rep> last_flush;
+
+    std::filesystem::path entry_path(const std::string & key);
+
+    // runs f(stats) with the counters file locked, writing back what f leaves in stats
+    template<typename F>
+    void with_stats(F f);
+
+    // merges this process's counts into the file, returns the totals
+    CacheStats flush();
+    void maybe_flush();
+    void evict(CacheStats & stats);
+
+public:
+    static constexpr uint64_t default_max_bytes = uint64_t(1) << 30;
+
+    ResultCache(std::filesystem::path directory, uint64_t max_bytes = default_max_bytes);
+    ~ResultCache();
+
+    static std::string key(std::span<const char> input, const std::string & operation);
+
+    // copies the cached output to output_path, returns false on a miss
+    bool fetch(const std::string & key, const char * output_path);
+    void store(const std::string & key, const char * output_path);
+
+    CacheStats stats();
+};
@@ -0,0 +1,286 @@
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <spanstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "command.hpp"
+#include "exceptions.hpp"
+#include "format/bmp.hpp"
+#include "ops/adjust.hpp"
+#include "ops/blur.hpp"
+#include "ops/overlay.hpp"
+#include "ops/phash.hpp"
+#include "ops/stats.hpp"
+#include "ops/tensor.hpp"
+#include "ops/tile.hpp"
+
+static void require_args(std::span<const std::string> args, size_t count) {
+    if (args.size() < count) {
+        throw invalid_usage();
+    }
+}
+
+static std::vector<char> read_file(const std::string & path) {
+    std::ifstream is(path, std::ios::binary);
+    if (!is.is_open()) {
+        throw invalid_file_path(path.c_str());
+    }
+    // sized up front and read in one call instead of growing a byte at a time
+    std::vector<char> bytes(std::filesystem::file_size(path));
+    is.read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    bytes.resize(static_cast<size_t>(is.gcount()));
+    return bytes;
+}
+
+// trailing -tensor options: --uint8, --alpha, --size <w>x<h>, --cut <x1> <y1> <x2> <y2>,
+// --mean <values...>, --std <values...> with one value per channel
+static TensorSpec parse_tensor_spec(std::span<const std::string> args) {
+    TensorSpec spec;
+    auto values = [&](size_t & i) {
+        std::vector<float> result;
+        while (i + 1 < args.size() && !args[i + 1].starts_with("--")) {
+            result.push_back(stof(args[++i]));
+        }
+        if (result.empty() || result.size() > 4) {
+            throw invalid_usage();
+        }
+        return result;
+    };
+
+    for (size_t i = 0; i < args.size(); i++) {
+        const std::string & option = args[i];
+        if (option == "--uint8") {
+            spec.type = TensorType::uint8;
+        } else if (option == "--alpha") {
+            spec.channels = 4;
+        } else if (option == "--size" && i + 1 < args.size()) {
+            const std::string & size = args[++i];
+            size_t x = size.find('x');
+            if (x == std::string::npos || stoi(size.substr(0, x)) <= 0 || stoi(size.substr(x + 1)) <= 0) {
+                throw invalid_usage();
+            }
+            spec.width = static_cast<unsigned int>(stoi(size.substr(0, x)));
+            spec.height = static_cast<unsigned int>(stoi(size.substr(x + 1)));
+        } else if (option == "--cut" && i + 4 < args.size()) {
+            vec2<int> a {stoi(args[i + 1]), stoi(args[i + 2])};
+            vec2<int> b {stoi(args[i + 3]), stoi(args[i + 4])};
+            spec.region = {a, b};
+            i += 4;
+        } else if (option == "--mean" || option == "--std") {
+            std::vector<float> given = values(i);
+            auto & target = option == "--mean" ? spec.mean : spec.stddev;
+            std::copy(given.begin(), given.end(), target.begin());
+        } else {
+            throw invalid_usage();
+        }
+    }
+    return spec;
+}
+
+static bool is_inline_input(const std::string & path, const CommandOptions & options) {
+    return path == "-" && options.inline_input.data() != nullptr;
+}
+
+// file contents, or the inline payload for "-"; storage holds what was read from disk
+static std::span<const char> input_bytes(const std::string & path, const CommandOptions & options, std::vector<char> & storage) {
+    if (is_inline_input(path, options)) {
+        return options.inline_input;
+    }
+    storage = read_file(path);
+    return storage;
+}
+
+static std::unique_ptr<Bitmap> load_bitmap(const std::string & path, const CommandOptions & options) {
+    if (is_inline_input(path, options)) {
+        std::ispanstream stream(options.inline_input);
+        return std::make_unique<Bitmap>(stream);
+    }
+    return std::make_unique<Bitmap>(path.c_str());
+}
+
+static void write_bitmap(Bitmap & bmp, const std::string & path, const CommandOptions & options) {
+    if (path == "-" && options.inline_output != nullptr) {
+        std::ostringstream stream;
+        bmp.write(stream);
+        *options.inline_output = std::move(stream).str();
+        return;
+    }
+    bmp.write(path.c_str());
+}
+
+// read-transform-write; with a cache the input is read into memory once,
+// hashed and then parsed from the same buffer, which is freed before the pixels are transformed.
+// the cache keeps files, so inline results bypass it
+static void run_transform(
+    const std::string & input,
+    const std::string & output,
+    const std::string & operation,
+    const CommandOptions & options,
+    std::function<void (Bitmap &)> apply
+) {
+    ResultCache * cache = options.cache;
+    if (cache == nullptr || (output == "-" && options.inline_output != nullptr)) {
+        std::unique_ptr<Bitmap> bmp = load_bitmap(input, options);
+        apply(*bmp);
+        write_bitmap(*bmp, output, options);
+        return;
+    }
+
+    std::string key;
+    std::unique_ptr<Bitmap> bmp;
+    {
+        std::vector<char> storage;
+        std::span<const char> bytes = input_bytes(input, options, storage);
+        key = ResultCache::key(bytes, operation);
+        if (cache->fetch(key, output.c_str())) {
+            return;
+        }
+        std::ispanstream stream(bytes);
+        bmp = std::make_unique<Bitmap>(stream);
+    }
+    apply(*bmp);
+    bmp->write(output.c_str());
+    cache->store(key, output.c_str());
+}
+
+void run_command(std::span<const std::string> args, std::ostream & output, const CommandOptions & options) {
+    require_args(args, 1);
+    ResultCache * cache = options.cache;
+    const std::string & command_name = args[0];
+
+    if (command_name == "-info") {
+        require_args(args, 2);
+        load_bitmap(args[1], options)->print_info(output);
+    } else if (command_name == "-rotate") {
+        require_args(args, 4);
+
+        int deg;
+        try {
+            deg = stoi(args[1]);
+        } catch (exception & e) {
+            throw invalid_degrees(args[1].c_str());
+        }
+        if ((abs(deg) % 90) != 0) {
+            throw invalid_degrees(deg);
+        }
+        deg = ((deg % 360) + 360) % 360;
+        run_transform(args[2], args[3], std::format("rotate {}", deg), options, [&](Bitmap & bmp) {
+            bmp.rotate(deg, options.in_place);
+        });
+    } else if (command_name == "-inverse") {
+        require_args(args, 3);
+        run_transform(args[1], args[2], "inverse", options, [&](Bitmap & bmp) {
+            bmp.inverse_colors(options.pool);
+        });
+    } else if (command_name == "-cut") {
+        require_args(args, 7);
+        vec2<int> a {stoi(args[1]), stoi(args[2])};
+        vec2<int> b {stoi(args[3]), stoi(args[4])};
+        run_transform(args[5], args[6], std::format("cut {} {} {} {}", a[0], a[1], b[0], b[1]), options, [&](Bitmap & bmp) {
+            bmp.cut(a, b);
+        });
+    } else if (command_name == "-adjust") {
+        require_args(args, 4);
+        PointOps ops = PointOps::parse(args[1]);
+        run_transform(args[2], args[3], std::format("adjust {}", ops.normalized()), options, [&](Bitmap & bmp) {
+            ops.apply(bmp, options.pool);
+        });
+    } else if (command_name == "-blur") {
+        require_args(args, 4);
+        int radius = stoi(args[1]);
+        std::string mode = args.size() > 4 ? args[4] : "box";
+        if (radius < 0 || (mode != "box" && mode != "gaussian")) {
+            throw invalid_usage();
+        }
+        run_transform(args[2], args[3], std::format("blur {} {}", radius, mode), options, [&](Bitmap & bmp) {
+            blur(bmp, static_cast<unsigned int>(radius), mode == "gaussian", options.pool);
+        });
+    } else if (command_name == "-convolve") {
+        require_args(args, 4);
+        SeparableKernel kernel = SeparableKernel::parse(args[1]);
+        run_transform(args[2], args[3], std::format("convolve {}", kernel.normalized()), options, [&](Bitmap & bmp) {
+            kernel.apply(bmp, options.pool);
+        });
+    } else if (command_name == "-overlay") {
+        require_args(args, 6);
+        int x = stoi(args[3]);
+        int y = stoi(args[4]);
+        std::string mode = args.size() > 6 ? args[6] : "straight";
+        if (mode != "straight" && mode != "premultiplied") {
+            throw invalid_usage();
+        }
+
+        // the top image is part of the operation, so its content goes into the cache key
+        std::vector<char> top_storage;
+        std::span<const char> top_bytes = input_bytes(args[2], options, top_storage);
+        std::string top_key = cache ? ResultCache::key(top_bytes, "") : "";
+        run_transform(args[1], args[5], std::format("overlay {} {} {} {}", top_key, x, y, mode), options, [&](Bitmap & base) {
+            std::ispanstream stream(top_bytes);
+            Bitmap top(stream);
+            overlay(base, top, x, y, mode == "premultiplied", options.pool);
+        });
+    } else if (command_name == "-tile") {
+        require_args(args, 4);
+        int size = stoi(args[1]);
+        bool pyramid = args.size() > 4 && args[4] == "--pyramid";
+        if (size <= 0 || (args.size() > 4 && !pyramid)) {
+            throw invalid_usage();
+        }
+        write_tiles(args[2].c_str(), args[3].c_str(), static_cast<unsigned int>(size), pyramid);
+    } else if (command_name == "-tensor") {
+        require_args(args, 3);
+        TensorSpec spec = parse_tensor_spec(args.subspan(3));
+        TensorDecoder decoder(args[1].c_str(), spec);
+        std::vector<char> tensor(decoder.byte_size());
+        decoder.decode(tensor.data());
+
+        std::ofstream os(args[2], std::ios::binary);
+        if (!os.is_open()) {
+            throw invalid_file_path(args[2].c_str());
+        }
+        os.write(tensor.data(), static_cast<std::streamsize>(tensor.size()));
+        os.close();
+        if (!os) {
+            throw write_error(args[2].c_str());
+        }
+        output << std::format("{{\"shape\":[{},{},{}],\"dtype\":\"{}\"}}\n", spec.channels, decoder.height(), decoder.width(),
+                              spec.type == TensorType::float32 ? "float32" : "uint8");
+    } else if (command_name == "-phash") {
+        // -phash [--ahash|--dhash] <input>... where @<file> lists more inputs
+        require_args(args, 2);
+        HashKind kind = HashKind::dct;
+        std::vector<std::string> inputs;
+        for (const std::string & arg : args.subspan(1)) {
+            if (arg == "--ahash") {
+                kind = HashKind::average;
+            } else if (arg == "--dhash") {
+                kind = HashKind::difference;
+            } else if (arg == "--phash") {
+                kind = HashKind::dct;
+            } else {
+                inputs.push_back(arg);
+            }
+        }
+        if (inputs.empty()) {
+            throw invalid_usage();
+        }
+        hash_files(inputs, kind, options.pool, output);
+    } else if (command_name == "-stats") {
+        require_args(args, 2);
+        output << stats_json(compute_stats(*load_bitmap(args[1], options), options.pool)) << '\n';
+    } else if (command_name == "-cache-stats") {
+        if (cache == nullptr) {
+            throw invalid_usage();
+        }
+        CacheStats stats = cache->stats();
+        uint64_t lookups = stats.hits + stats.misses;
+        output << std::format("{{\"hits\":{},\"misses\":{},\"hit_rate\":{:.4f},\"bytes\":{}}}\n",
+            stats.hits, stats.misses, lookups ? static_cast<double>(stats.hits) / static_cast<double>(lookups) : 0.0, stats.bytes);
+    } else {
+        throw invalid_usage();
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <ostream>
+#include <span>
+#include <string>
+#include "cache/result_cache.hpp"
+#include "util/thread_pool.hpp"
+
+struct CommandOptions {
+    ResultCache * cache = nullptr; // transforming commands reuse results from here
+    bool in_place = false; // rotate without a second copy of the pixels, see BitmapPixelArray::rotate_90
+    ThreadPool * pool = nullptr; // batch commands and row band filters spread their work over it, without one they run on the calling thread
+
+    // request payloads: with inline_input set, an input argument "-" reads it instead of a file,
+    // with inline_output set, an output argument "-" writes the resulting bitmap there
+    std::span<const char> inline_input;
+    std::string * inline_output = nullptr;
+};
+
+// runs a single command, e.g. {"-rotate", "90", "in.bmp", "out.bmp"}
+// throws invalid_usage if the arguments do not match the command
+void run_command(std::span<const std::string> args, std::ostream & output, const CommandOptions & options = {});
@@ -23,4 +23,36 @@ class invalid_degrees : public invalid_argument {
 class invalid_coordinates : public invalid_argument {
     public: invalid_coordinates(const char * str) : invalid_argument(format("invalid coordinates: {}", str)) {}
     public: invalid_coordinates(vec2<int> a, vec2<int> b) : invalid_argument(format("invalid coordinates: {}, {}", a, b)) {}
-};
\ No newline at end of file
+};
+
+class write_error : public runtime_error {
+    public: write_error(const char * path) : runtime_error(format("could not write {}", path)) {}
+};
+
+class unsupported_bitmap : public logic_error {
+    public: unsupported_bitmap(const char * what) : logic_error(format("unsupported bitmap: {}", what)) {}
+};
+
+class invalid_bitmap : public invalid_argument {
+    public: invalid_bitmap(const char * what) : invalid_argument(format("invalid bitmap: {}", what)) {}
+};
+
+class invalid_usage : public invalid_argument {
+    public: invalid_usage() : invalid_argument("invalid usage") {}
+};
+
+class socket_error : public runtime_error {
+    public: socket_error(const char * what) : runtime_error(format("socket error: {}", what)) {}
+};
+
+class invalid_adjustment : public invalid_argument {
+    public: invalid_adjustment(string_view op) : invalid_argument(format("invalid adjustment: {}", op)) {}
+};
+
+class invalid_radius : public invalid_argument {
+    public: invalid_radius(unsigned int radius, unsigned int limit) : invalid_argument(format("blur radius {} exceeds the image size {}", radius, limit)) {}
+};
+
+class invalid_kernel : public invalid_argument {
+    public: invalid_kernel(string_view kernel) : invalid_argument(format("invalid kernel: {}", kernel)) {}
+};
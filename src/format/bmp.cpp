@@ -1,10 +1,13 @@
 #include <cassert>
+#include <cstdint>
+#include <cstdlib>
 #include <print>
 #include <fstream>
 #include "bmp.hpp"
 #include "exceptions.hpp"
 #include "format/pixel_array/expanded.hpp"
 #include "format/pixel_array/packed.hpp"
+#include "ops/adjust.hpp"
 
 namespace io {
     template<typename T>
@@ -33,6 +36,31 @@ namespace io {
     }
 }
 
+Bitmap::Bitmap(uint16_t bits_per_pixel, unsigned int width, int height, std::vector<color> color_table)
+    : file_header{}
+    , header{}
+    , color_table(std::move(color_table)) {
+    header.header_size = sizeof(BitmapV5Header);
+    header.planes = 1;
+    header.x_pixels_per_metre = 2835; // 72 dpi
+    header.y_pixels_per_metre = 2835;
+    header.color_space_type = BitmapV5Header::LCS_sRGB;
+    header.intent = BitmapV5Header::LCS_GM_IMAGES;
+    set_format(bits_per_pixel, width, height);
+}
+
+Bitmap::Bitmap() : file_header{}, header{} {
+}
+
+Bitmap::Bitmap(Bitmap & source, vec2<int> a, vec2<int> b)
+    : file_header(source.file_header)
+    , header(source.header)
+    , color_table(source.color_table) {
+    auto [ua, ub] = source.region(a, b);
+    pixels = source.pixels->crop(ua, ub, color_table);
+    update_sizes();
+}
+
 Bitmap::Bitmap(std::istream & input) {
     read(input);
 }
@@ -41,7 +69,19 @@ Bitmap::Bitmap(const char * path) {
     read(path);
 }
 
+Bitmap::~Bitmap() {
+    delete pixels;
+}
+
 void Bitmap::read(std::istream & input) {
+    read_header(input);
+    // before allocate_pixels, which recomputes the offset for writing
+    input.seekg(file_header.pixel_array_offset);
+    allocate_pixels(header.bitmap_width, header.bitmap_height);
+    io::read(input, pixels->data(), pixels->byte_size());
+}
+
+void Bitmap::read_header(std::istream & input) {
     std::array<std::uint8_t, 2> signature;
     io::read(input, signature.data(), signature.size() * sizeof(signature[0]));
 
@@ -56,24 +96,60 @@ void Bitmap::read(std::istream & input) {
     uint32_t header_size;
     io::read(input, &header_size);
 
-    assert(header_size == sizeof(BitmapV5Header));
+    if (header_size != sizeof(BitmapV5Header)) {
+        throw unsupported_bitmap("only BITMAPV5HEADER is supported");
+    }
     header.header_size = header_size;
     io::read(input, &header.bitmap_width, header_size - sizeof(header.header_size));
 
+    if (header.bits_per_pixel != 1 && header.bits_per_pixel != 2 && header.bits_per_pixel != 4
+            && header.bits_per_pixel != 8 && header.bits_per_pixel != 16 && header.bits_per_pixel != 24
+            && header.bits_per_pixel != 32) {
+        throw unsupported_bitmap("bits per pixel should be 1, 2, 4, 8, 16, 24 or 32");
+    }
+    if (header.bits_per_pixel == 32 && header.compression == BitmapCoreHeader::BITFIELDS
+            && (header.red_channel_bitmask != 0x00FF0000 || header.green_channel_bitmask != 0x0000FF00
+                || header.blue_channel_bitmask != 0x000000FF)) {
+        throw unsupported_bitmap("32bpp channel masks other than b, g, r, a");
+    }
+
+    // the sizes below come straight from the file and decide what gets allocated
+    if (header.bitmap_width <= 0 || header.bitmap_height == 0 || header.bitmap_height == INT32_MIN) {
+        throw invalid_bitmap("width must be positive and height non-zero");
+    }
+    uint64_t row_size = (uint64_t(header.bits_per_pixel) * uint32_t(header.bitmap_width) + 31) / 32 * 4;
+    if (row_size * uint64_t(std::abs(header.bitmap_height)) > INT32_MAX) {
+        throw invalid_bitmap("pixel array larger than 2 GiB");
+    }
+    if (header.colors > (header.bits_per_pixel <= 8 ? 1u << header.bits_per_pixel : 256u)) {
+        throw invalid_bitmap("more colors than the bit depth can index");
+    }
+    // the pixels start at the offset given in the file header, which may leave a gap,
+    // e.g. for an ICC profile, after the color table
+    if (file_header.pixel_array_offset < BitmapSignature.size() + sizeof(file_header) + header_size + sizeof(vec4<uint8_t>) * header.colors) {
+        throw invalid_bitmap("pixel array overlaps the headers");
+    }
+
     color_table = std::vector<vec4<uint8_t>>(header.colors);
     io::read(input, color_table.data(), sizeof(vec4<uint8_t>) * header.colors);
 
+    delete pixels;
+    pixels = nullptr;
+}
+
+void Bitmap::allocate_pixels(unsigned int width, int height) {
+    delete pixels;
     if (header.bits_per_pixel < 8) {
-        pixels = new PackedBitmapPixelArray(header.bits_per_pixel, header.bitmap_width, header.bitmap_height, color_table);
+        pixels = new PackedBitmapPixelArray(header.bits_per_pixel, width, height, color_table);
     } else {
         uint32_t rmask = header.red_channel_bitmask;
         uint32_t gmask = header.green_channel_bitmask;
         uint32_t bmask = header.blue_channel_bitmask;
-        
-        pixels = new ExpandedBitmapPixelArray(header.bits_per_pixel, header.bitmap_width, header.bitmap_height, color_table, rmask, gmask, bmask);
-    }
+        uint32_t amask = header.bits_per_pixel == 32 ? header.alpha_channel_bitmask : 0;
 
-    io::read(input, pixels->data(), pixels->byte_size());
+        pixels = new ExpandedBitmapPixelArray(header.bits_per_pixel, width, height, color_table, rmask, gmask, bmask, amask);
+    }
+    update_sizes();
 }
 
 void Bitmap::read(const char * path) {
@@ -100,37 +176,109 @@ void Bitmap::write(const char * path) {
     write(os);
 }
 
-void Bitmap::rotate_90() {
+void Bitmap::set_format(uint16_t bits_per_pixel, unsigned int width, int height) {
+    header.bits_per_pixel = bits_per_pixel;
+    header.colors = static_cast<uint32_t>(color_table.size());
+    header.importrant_color_count = 0;
+
+    if (bits_per_pixel == 32) {
+        // BITMAPV5HEADER only honours the alpha mask with BI_BITFIELDS
+        header.compression = BitmapCoreHeader::BITFIELDS;
+        header.red_channel_bitmask = 0x00FF0000;
+        header.green_channel_bitmask = 0x0000FF00;
+        header.blue_channel_bitmask = 0x000000FF;
+        header.alpha_channel_bitmask = 0xFF000000;
+    } else {
+        header.compression = BitmapCoreHeader::RGB;
+        header.red_channel_bitmask = 0;
+        header.green_channel_bitmask = 0;
+        header.blue_channel_bitmask = 0;
+        header.alpha_channel_bitmask = 0;
+    }
+
+    allocate_pixels(width, height);
+}
+
+void Bitmap::update_sizes() {
+    header.bitmap_width = static_cast<int32_t>(pixels->width());
+    header.bitmap_height = static_cast<int32_t>(pixels->height());
+    header.image_size = static_cast<uint32_t>(pixels->byte_size());
+    file_header.pixel_array_offset = static_cast<uint32_t>(BitmapSignature.size() + sizeof(file_header)
+        + header.header_size + color_table.size() * sizeof(color_table[0]));
+    file_header.file_size = file_header.pixel_array_offset + header.image_size;
+}
+
+void Bitmap::expand_to(uint16_t bits_per_pixel) {
+    assert(bits_per_pixel == 24 || bits_per_pixel == 32);
+    if (header.bits_per_pixel == bits_per_pixel) {
+        return;
+    }
+
+    BitmapPixelArray * source = pixels;
+    pixels = nullptr;
+    unsigned int width = source->width();
+    int height = source->height();
+    unsigned int rows = static_cast<unsigned int>(abs(height));
+    set_format(bits_per_pixel, width, height);
+
+    unsigned int bytes_per_pixel = bits_per_pixel / 8;
+    std::vector<color> row(width);
+    for (unsigned int i = 0; i < rows; i++) {
+        source->get_row(i, row.data());
+        unsigned int storage_row = height > 0 ? rows - 1 - i : i;
+        uint8_t * p = pixels->data() + size_t(storage_row) * pixels->row_byte_size();
+        for (unsigned int j = 0; j < width; j++, p += bytes_per_pixel) {
+            p[0] = row[j][2];
+            p[1] = row[j][1];
+            p[2] = row[j][0];
+            if (bytes_per_pixel == 4) {
+                p[3] = row[j][3];
+            }
+        }
+    }
+    delete source;
+
+    // the source decoded through the color table until now
+    color_table.clear();
+    header.colors = 0;
+    update_sizes();
+}
+
+void Bitmap::rotate_90(bool in_place, bool clockwise) {
     file_header.file_size -= pixels->byte_size();
-    pixels->rotate_90();
+    pixels->rotate_90(in_place, clockwise);
     header.bitmap_width  = static_cast<int32_t>(pixels->width());
     header.bitmap_height = static_cast<int32_t>(pixels->height()); // contains sign for top-down vs bottom-up
     file_header.file_size += pixels->byte_size();
 }
 
-void Bitmap::rotate(int deg) {
+void Bitmap::rotate(int deg, bool in_place) {
     if ((abs(deg) % 90) != 0) {
         throw invalid_degrees(deg);
     }
-    if (deg < 0) {
-        deg = 360 - 90;
-    }
-    deg %= 360;
-    for (int i = 0; i < deg / 90; i++) {
-        rotate_90();
+    deg = ((deg % 360) + 360) % 360;
+    if (deg == 180) {
+        pixels->rotate_180();
+    } else if (deg != 0) {
+        rotate_90(in_place, deg == 90);
     }
 }
 
-void Bitmap::cut(vec2<int> a, vec2<int> b) {
+std::pair<vec2<unsigned int>, vec2<unsigned int>> Bitmap::region(vec2<int> a, vec2<int> b) {
     if (a[0] > b[0] || a[1] > b[1]
             || a[0] < 0 || a[1] < 0 || b[0] < 0 || b[1] < 0
-            || a[0] > header.bitmap_width
-            || b[0] > header.bitmap_height) {
+            || b[0] >= static_cast<int>(pixels->width())
+            || b[1] >= abs(pixels->height())) {
         throw invalid_coordinates(a, b);
     }
 
     vec2<unsigned int> ua {static_cast<unsigned int>(a[0]), static_cast<unsigned int>(a[1])};
     vec2<unsigned int> ub {static_cast<unsigned int>(b[0]), static_cast<unsigned int>(b[1])};
+    return {ua, ub};
+}
+
+void Bitmap::cut(vec2<int> a, vec2<int> b) {
+    auto [ua, ub] = region(a, b);
 
     file_header.file_size -= pixels->byte_size();
     pixels->cut(ua, ub);
@@ -140,41 +288,12 @@ void Bitmap::cut(vec2<int> a, vec2<int> b) {
 }
 
 
-void Bitmap::print_info() {
-    std::println("file size: {}", file_header.file_size);
-    std::println("bitmap size: {}x{} pixels", header.bitmap_width, abs(header.bitmap_height));
-    std::println("bits per pixel: {}", header.bits_per_pixel);
+void Bitmap::print_info(std::ostream & output) {
+    std::println(output, "file size: {}", file_header.file_size);
+    std::println(output, "bitmap size: {}x{} pixels", header.bitmap_width, abs(header.bitmap_height));
+    std::println(output, "bits per pixel: {}", header.bits_per_pixel);
 }
 
-void Bitmap::inverse_colors() {
-    if (header.bits_per_pixel <= 8) {
-        for (auto & color : color_table) {
-            for (int i = 0; i < 3; i++) {
-                color[i] = 255 - color[i];
-            }
-        }
-    } 
-
-    if (header.bits_per_pixel == 16) {
-        auto *data = reinterpret_cast<uint16_t *>(pixels->data());
-        size_t num_pixels = pixels->width() * abs(pixels->height());
-        for (size_t i = 0; i < num_pixels; ++i) {
-            uint16_t pixel = data[i];
-            uint8_t r = 31 - ((pixel >> 11) & 0x1F);
-            uint8_t g = 63 - ((pixel >> 5) & 0x3F);
-            uint8_t b = 31 - (pixel & 0x1F);
-            data[i] = (r << 11) | (g << 5) | b;
-        }
-    }
-
-    if (header.bits_per_pixel == 24) {
-        uint8_t *data = pixels->data();
-        size_t num_pixels = pixels->width() * abs(pixels->height());
-        for (size_t i = 0; i < num_pixels; ++i) {
-            data[i*3 + 0] = 255 - data[i*3 + 0]; // blue
-            data[i*3 + 1] = 255 - data[i*3 + 1]; // green
-            data[i*3 + 2] = 255 - data[i*3 + 2]; // red
-        }
-    }
-
-}
\ No newline at end of file
+void Bitmap::inverse_colors(ThreadPool * pool) {
+    PointOps::parse("invert").apply(*this, pool);
+}
@@ -1,8 +1,11 @@
 #pragma once
 
 #include <istream>
+#include <utility>
+#include <iostream>
 #include <vector>
 #include "pixel_array.hpp"
+#include "util/thread_pool.hpp"
 
 constexpr std::array<uint8_t, 2> BitmapSignature = {0x42, 0x4D};
 
@@ -72,16 +75,32 @@ struct BitmapV5Header : BitmapCoreHeader {
 class Bitmap {
     BitmapFileHeader file_header;
 
+    // replaces the pixel array with a blank one and fills in the header to match
+    void set_format(uint16_t bits_per_pixel, unsigned int width, int height);
+
+    // validated corners of a cut, inclusive
+    std::pair<vec2<unsigned int>, vec2<unsigned int>> region(vec2<int> a, vec2<int> b);
+
 public:
     // everyone uses BITMAPV5HEADER anyway
     BitmapV5Header header;
     std::vector<vec4<uint8_t>> color_table;
     BitmapPixelArray * pixels = nullptr;
 
-    Bitmap(BitmapV5Header file_header, BitmapV5Header header, std::vector<vec4<uint8_t>> color_table, BitmapPixelArray * pixels);
+    // no pixels, for read_header
+    Bitmap();
+    // blank bitmap, height sign as in the header (positive for bottom-up)
+    Bitmap(uint16_t bits_per_pixel, unsigned int width, int height, std::vector<color> color_table = {});
+    // copy of the a..b region of source, same format and row order
+    Bitmap(Bitmap & source, vec2<int> a, vec2<int> b);
 
     Bitmap(std::istream & input);
     Bitmap(const char * path);
+    ~Bitmap();
+
+    // pixel arrays keep a reference to color_table
+    Bitmap(const Bitmap &) = delete;
+    Bitmap & operator=(const Bitmap &) = delete;
 
     void write(std::ostream & output);
     void write(const char * path);
@@ -89,12 +108,27 @@ public:
     void read(std::istream & input);
     void read(const char * path);
 
-    void rotate_90();
-    void rotate(int deg);
+    // everything up to the pixel array, leaves pixels empty
+    void read_header(std::istream & input);
+    // file offset of the pixel array, from the file header
+    uint32_t pixel_array_offset() const { return file_header.pixel_array_offset; }
+    // blank pixel array in the format given by the header
+    void allocate_pixels(unsigned int width, int height);
+
+    void rotate_90(bool in_place = false, bool clockwise = true);
+    // every multiple of 90 takes a single pass over the pixels
+    void rotate(int deg, bool in_place = false);
 
     void cut(vec2<int> a, vec2<int> b);
 
-    void print_info();
+    // converts indexed and 16bpp images to 24 or 32bpp direct color
+    void expand_to(uint16_t bits_per_pixel);
+
+    // recomputes header and file sizes from the pixel array
+    void update_sizes();
+
+    void print_info(std::ostream & output = std::cout);
 
-    void inverse_colors();
+    // bands of rows go to pool when one is given
+    void inverse_colors(ThreadPool * pool = nullptr);
 };
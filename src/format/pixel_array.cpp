@@ -1,9 +1,18 @@
+#include <algorithm>
 #include <cmath>
+#include "format/pixel_array.hpp"
 
 int get_row_size(unsigned int bits_per_pixel, unsigned int image_width) {
-    return ceil(((float) bits_per_pixel * (float) image_width) / 32) * 4;
+    return static_cast<int>((uint64_t(bits_per_pixel) * image_width + 31) / 32 * 4);
 }
 
 int get_pixel_array_size(unsigned int row_size, int image_height) {
     return row_size * abs(image_height);
-}
\ No newline at end of file
+}
+
+size_t get_rotation_capacity(unsigned int bits_per_pixel, unsigned int image_width, int image_height) {
+    unsigned int rows = abs(image_height);
+    size_t as_is = size_t(get_row_size(bits_per_pixel, image_width)) * rows;
+    size_t rotated = size_t(get_row_size(bits_per_pixel, rows)) * image_width;
+    return std::max(as_is, rotated);
+}
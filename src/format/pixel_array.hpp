@@ -2,22 +2,46 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <vector>
 #include "math/vec.hpp"
 
-using color = vec4<uint8_t>;
+using color = vec4<uint8_t>; // r, g, b, a
+
+// color table entries are stored as b, g, r, reserved
+inline color palette_color(const std::vector<color> & color_table, unsigned int index) {
+    if (index >= color_table.size()) {
+        return color{0, 0, 0, 255};
+    }
+    const color & entry = color_table[index];
+    return color{entry[2], entry[1], entry[0], 255};
+}
 
 int get_row_size(uint32_t bits_per_pixel, uint32_t image_width);
 int get_pixel_array_size(uint32_t row_size, int32_t image_height);
+// bytes needed to hold the pixel array in either orientation, so rotation never reallocates
+size_t get_rotation_capacity(uint32_t bits_per_pixel, uint32_t image_width, int32_t image_height);
 
 class BitmapPixelArray {
 public:
+    virtual ~BitmapPixelArray() = default;
+
     virtual color get_pixel(unsigned int i, unsigned int j) = 0;
+    // decodes count pixels of the i-th row from the top, starting at column first
+    virtual void get_row(unsigned int i, color * out, unsigned int first, unsigned int count) = 0;
+    // the whole row, width() colors
+    void get_row(unsigned int i, color * out) { get_row(i, out, 0, width()); }
     virtual unsigned int width() = 0;
     virtual int height() = 0;
 
-    virtual void rotate_90() = 0;
+    // in_place trades speed for not holding a second copy of the pixels. non-square images
+    // still keep one bit per pixel, so 1bpp arrays gain nothing and rotate through a copy anyway
+    virtual void rotate_90(bool in_place = false, bool clockwise = true) = 0;
+    // mirrors the storage in both directions, always in place
+    virtual void rotate_180() = 0;
 
     virtual void cut(vec2<unsigned int> a, vec2<unsigned int> b) = 0;
+    // new array holding the a..b region, bound to color_table
+    virtual BitmapPixelArray * crop(vec2<unsigned int> a, vec2<unsigned int> b, std::vector<color> & color_table) = 0;
 
     virtual uint8_t * data() = 0;
     virtual size_t byte_size() = 0;
@@ -1,5 +1,8 @@
 #include "format/pixel_array/expanded.hpp"
+#include "format/pixel_array/rotate.hpp"
 #include <cassert>
+#include <cstring>
+#include <memory>
 
 inline unsigned int ExpandedBitmapPixelArray::tz_count(uint32_t v) {
     if (v == 0) return 32;
@@ -16,7 +19,8 @@ ExpandedBitmapPixelArray::ExpandedBitmapPixelArray(
     std::vector<color>& color_table_,
     uint32_t rmask,
     uint32_t gmask,
-    uint32_t bmask
+    uint32_t bmask,
+    uint32_t amask
 ) :
     bits_per_pixel(bits_per_pixel),
     w(width_), h(height_),
@@ -24,11 +28,11 @@ ExpandedBitmapPixelArray::ExpandedBitmapPixelArray(
     row_size(static_cast<unsigned int>(get_row_size(bits_per_pixel, width_))),
     pixel_array_size_in_bytes(static_cast<unsigned int>(get_pixel_array_size(row_size, height_))),
     height_signed(height_ > 0),
-    pixels(static_cast<unsigned int>(std::abs(height_)), row_size),
+    pixels(static_cast<unsigned int>(std::abs(height_)), row_size, get_rotation_capacity(bits_per_pixel, width_, height_)),
     color_table(color_table_),
-    red_mask(rmask), green_mask(gmask), blue_mask(bmask)
+    red_mask(rmask), green_mask(gmask), blue_mask(bmask), alpha_mask(amask)
 {
-    assert(bits_per_pixel == 8 || bits_per_pixel == 16 || bits_per_pixel == 24);
+    assert(bits_per_pixel == 8 || bits_per_pixel == 16 || bits_per_pixel == 24 || bits_per_pixel == 32);
     assert(bytes_per_pixel * 8 == bits_per_pixel);
 }
 
@@ -78,6 +82,31 @@ color ExpandedBitmapPixelArray::color_from_16bit(uint16_t v) const {
     return color{ r, g, b, 255u };
 }
 
+uint16_t ExpandedBitmapPixelArray::color_to_16bit(color c) const {
+    uint32_t rmask_local = red_mask;
+    uint32_t gmask_local = green_mask;
+    uint32_t bmask_local = blue_mask;
+
+    if (rmask_local == 0 && gmask_local == 0 && bmask_local == 0) {
+        // RGB565
+        rmask_local = 0xF800u;
+        gmask_local = 0x07E0u;
+        bmask_local = 0x001Fu;
+    }
+
+    auto pack_comp = [](uint8_t comp8, uint32_t mask)->uint32_t {
+        if (mask == 0) return 0;
+        unsigned int shift = tz_count(mask);
+        unsigned int bits = bit_count(mask);
+        uint32_t maxv = (1u << bits) - 1u;
+        uint32_t small = (static_cast<uint32_t>(comp8) * maxv + 127u) / 255u;
+        return (small << shift) & mask;
+    };
+
+    uint32_t v = pack_comp(c[0], rmask_local) | pack_comp(c[1], gmask_local) | pack_comp(c[2], bmask_local);
+    return static_cast<uint16_t>(v & 0xFFFFu);
+}
+
 color ExpandedBitmapPixelArray::get_pixel(unsigned int i, unsigned int j) {
     unsigned int rows = pixels.rows();
     unsigned int row_index = (height_signed ? (rows - 1 - i) : i);
@@ -89,9 +118,7 @@ color ExpandedBitmapPixelArray::get_pixel(unsigned int i, unsigned int j) {
     }
 
     if (bits_per_pixel == 8) {
-        uint8_t idx = pixels(row_index, byte_index);
-        if (idx < color_table.size()) return color_table[idx];
-        return color{0,0,0,255};
+        return palette_color(color_table, pixels(row_index, byte_index));
     } else if (bits_per_pixel == 16) {
         uint16_t lo = pixels(row_index, byte_index);
         uint16_t hi = pixels(row_index, byte_index + 1);
@@ -101,103 +128,80 @@ color ExpandedBitmapPixelArray::get_pixel(unsigned int i, unsigned int j) {
         uint8_t b = pixels(row_index, byte_index + 0);
         uint8_t g = pixels(row_index, byte_index + 1);
         uint8_t r = pixels(row_index, byte_index + 2);
-        return color{ r, g, b, 255u };
+        uint8_t a = (bits_per_pixel == 32 && alpha_mask != 0) ? pixels(row_index, byte_index + 3) : 255u;
+        return color{ r, g, b, a };
     }
 }
 
-void ExpandedBitmapPixelArray::rotate_90() {
-    int new_h = height_signed ? -static_cast<int>(w) : static_cast<int>(w);
-    unsigned int new_w = static_cast<unsigned int>(std::abs(h));
+void ExpandedBitmapPixelArray::get_row(unsigned int i, color * out, unsigned int first, unsigned int count) {
+    unsigned int rows = pixels.rows();
+    unsigned int row_index = (height_signed ? (rows - 1 - i) : i);
+    const uint8_t * p = &pixels(row_index, 0) + size_t(first) * bytes_per_pixel;
+
+    if (bits_per_pixel == 8) {
+        for (unsigned int j = 0; j < count; j++) {
+            out[j] = palette_color(color_table, p[j]);
+        }
+    } else if (bits_per_pixel == 16) {
+        for (unsigned int j = 0; j < count; j++) {
+            out[j] = color_from_16bit(static_cast<uint16_t>(p[2 * j] | (p[2 * j + 1] << 8)));
+        }
+    } else if (bits_per_pixel == 24) {
+        for (unsigned int j = 0; j < count; j++, p += 3) {
+            out[j] = color{ p[2], p[1], p[0], 255u };
+        }
+    } else {
+        for (unsigned int j = 0; j < count; j++, p += 4) {
+            out[j] = color{ p[2], p[1], p[0], alpha_mask != 0 ? p[3] : uint8_t(255u) };
+        }
+    }
+}
+
+void ExpandedBitmapPixelArray::rotate_90(bool in_place, bool clockwise) {
+    unsigned int rows = static_cast<unsigned int>(std::abs(h));
+    unsigned int new_w = rows;
+    int new_h = height_signed ? static_cast<int>(w) : -static_cast<int>(w);
 
     unsigned int new_row_size = static_cast<unsigned int>(get_row_size(bits_per_pixel, new_w));
     unsigned int new_pixel_array_size = static_cast<unsigned int>(get_pixel_array_size(new_row_size, new_h));
 
-    matrix<uint8_t> new_pixels(static_cast<unsigned int>(std::abs(new_h)), new_row_size);
-
-    for (unsigned int i = 0; i < static_cast<unsigned int>(std::abs(new_h)); ++i) {
-        for (unsigned int j = 0; j < new_w; ++j) {
-            color c = get_pixel(new_w - 1 - j, i);
-
-            unsigned int dest_byte = j * bytes_per_pixel;
-            if (dest_byte + bytes_per_pixel > new_pixels.columns()) continue;
-
-            if (bits_per_pixel == 8) {
-                uint8_t idx = 0;
-                bool found = false;
-                for (uint32_t k = 0; k < color_table.size(); ++k) {
-                    if (color_table[k] == c) { idx = static_cast<uint8_t>(k); found = true; break; }
-                }
-                new_pixels(i, dest_byte) = idx;
-            } else if (bits_per_pixel == 16) {
-                uint32_t rmask_local = red_mask, gmask_local = green_mask, bmask_local = blue_mask;
-                uint16_t packed = 0;
-                if (rmask_local == 0 && gmask_local == 0 && bmask_local == 0) {
-                    // RGB565
-                    uint16_t r5 = static_cast<uint16_t>((c[0] * 31 + 127) / 255) & 0x1F;
-                    uint16_t g6 = static_cast<uint16_t>((c[1] * 63 + 127) / 255) & 0x3F;
-                    uint16_t b5 = static_cast<uint16_t>((c[2] * 31 + 127) / 255) & 0x1F;
-                    packed = static_cast<uint16_t>((r5 << 11) | (g6 << 5) | b5);
-                } else {
-                    auto pack_comp = [&](uint8_t comp8, uint32_t mask)->uint32_t {
-                        if (mask == 0) return 0;
-                        unsigned int shift = tz_count(mask);
-                        unsigned int bits = bit_count(mask);
-                        uint32_t maxv = (1u<<bits)-1u;
-                        uint32_t small = (static_cast<uint32_t>(comp8) * maxv + 127u) / 255u;
-                        return (small << shift) & mask;
-                    };
-                    uint32_t v = pack_comp(c[0], rmask_local) | pack_comp(c[1], gmask_local) | pack_comp(c[2], bmask_local);
-                    packed = static_cast<uint16_t>(v & 0xFFFFu);
-                }
-                new_pixels(i, dest_byte + 0) = static_cast<uint8_t>(packed & 0xFFu);
-                new_pixels(i, dest_byte + 1) = static_cast<uint8_t>((packed >> 8) & 0xFFu);
-            } else {
-                new_pixels(i, dest_byte + 0) = c[2]; // B
-                new_pixels(i, dest_byte + 1) = c[1]; // G
-                new_pixels(i, dest_byte + 2) = c[0]; // R
-            }
-        }
-    }
+    // bottom-up rows turn the other way in storage
+    rotate_pixels_90(pixels, ByteElements{pixels.data(), bytes_per_pixel}, w, rows, clockwise != height_signed, new_row_size, in_place);
 
-    pixels = std::move(new_pixels);
     w = new_w;
     h = new_h;
     row_size = new_row_size;
     pixel_array_size_in_bytes = new_pixel_array_size;
-    height_signed = (h > 0);
 }
 
-void ExpandedBitmapPixelArray::cut(vec2<unsigned int> a, vec2<unsigned int> b) {
+void ExpandedBitmapPixelArray::rotate_180() {
+    rotate_pixels_180(pixels, ByteElements{pixels.data(), bytes_per_pixel}, w, static_cast<unsigned int>(std::abs(h)));
+}
+
+BitmapPixelArray * ExpandedBitmapPixelArray::crop(vec2<unsigned int> a, vec2<unsigned int> b, std::vector<color> & table) {
     assert(a[0] <= b[0]);
     assert(a[1] <= b[1]);
 
     unsigned int new_w = b[0] - a[0] + 1u;
-    int raw_new_h = static_cast<int>(b[1] - a[1] + 1u);
-    int new_h = height_signed ? -raw_new_h : raw_new_h;
+    unsigned int new_rows = b[1] - a[1] + 1u;
+    int new_h = height_signed ? static_cast<int>(new_rows) : -static_cast<int>(new_rows);
 
-    unsigned int new_row_size = static_cast<unsigned int>(get_row_size(bits_per_pixel, new_w));
-    unsigned int new_pixel_array_size = static_cast<unsigned int>(get_pixel_array_size(new_row_size, new_h));
-
-    matrix<uint8_t> new_pixels(static_cast<unsigned int>(std::abs(new_h)), new_row_size);
-
-    for (unsigned int i = 0; i < static_cast<unsigned int>(std::abs(new_h)); ++i) {
-        unsigned int src_y = a[1] + i;
-        for (unsigned int j = 0; j < new_w; ++j) {
-            unsigned int src_x = a[0] + j;
-            unsigned int src_row = height_signed ? (pixels.rows() - 1 - src_y) : src_y;
-            unsigned int src_byte = src_x * bytes_per_pixel;
-            unsigned int dst_byte = j * bytes_per_pixel;
+    auto * cropped = new ExpandedBitmapPixelArray(bits_per_pixel, new_w, new_h, table, red_mask, green_mask, blue_mask, alpha_mask);
 
-            for (unsigned int b = 0; b < bytes_per_pixel; ++b) {
-                uint8_t v = pixels(src_row, src_byte + b);
-                new_pixels(i, dst_byte + b) = v;
-            }
-        }
+    // rows keep their order, so a bottom-up cut starts at the bottom of the source too
+    unsigned int first_row = height_signed ? pixels.rows() - 1 - b[1] : a[1];
+    for (unsigned int i = 0; i < new_rows; ++i) {
+        std::memcpy(&cropped->pixels(i, 0), &pixels(first_row + i, a[0] * bytes_per_pixel), new_w * bytes_per_pixel);
     }
+    return cropped;
+}
 
-    pixels = std::move(new_pixels);
-    w = new_w;
-    h = new_h;
-    row_size = new_row_size;
-    pixel_array_size_in_bytes = new_pixel_array_size;
+void ExpandedBitmapPixelArray::cut(vec2<unsigned int> a, vec2<unsigned int> b) {
+    std::unique_ptr<ExpandedBitmapPixelArray> cropped(static_cast<ExpandedBitmapPixelArray *>(crop(a, b, color_table)));
+
+    pixels = std::move(cropped->pixels);
+    w = cropped->w;
+    h = cropped->h;
+    row_size = cropped->row_size;
+    pixel_array_size_in_bytes = cropped->pixel_array_size_in_bytes;
 }
@@ -21,6 +21,8 @@ public:
     uint32_t red_mask;
     uint32_t green_mask;
     uint32_t blue_mask;
+    // 32bpp is always b, g, r, a in memory; without an alpha mask pixels are opaque
+    uint32_t alpha_mask;
 
     ExpandedBitmapPixelArray(
         uint16_t bits_per_pixel,
@@ -29,24 +31,31 @@ public:
         std::vector<color>& color_table,
         uint32_t red_mask = 0,
         uint32_t green_mask = 0,
-        uint32_t blue_mask = 0
+        uint32_t blue_mask = 0,
+        uint32_t alpha_mask = 0
     );
 
     unsigned int width() override;
     int height() override;
 
     color get_pixel(unsigned int i, unsigned int j) override;
+    using BitmapPixelArray::get_row;
+    void get_row(unsigned int i, color * out, unsigned int first, unsigned int count) override;
     
-    void rotate_90() override;
+    void rotate_90(bool in_place = false, bool clockwise = true) override;
+    void rotate_180() override;
     void cut(vec2<unsigned int> a, vec2<unsigned int> b) override;
+    BitmapPixelArray * crop(vec2<unsigned int> a, vec2<unsigned int> b, std::vector<color> & color_table) override;
 
     uint8_t * data() override;
     size_t byte_size() override;
     int row_byte_size() override;
 
+    color color_from_16bit(uint16_t v) const;
+    uint16_t color_to_16bit(color c) const;
+
 private:
     // helpers
-    color color_from_16bit(uint16_t v) const;
     static inline unsigned int tz_count(uint32_t v); // count trailing zeros
     static inline unsigned int bit_count(uint32_t v); // count bits in mask
 };
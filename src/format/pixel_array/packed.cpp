@@ -1,35 +1,54 @@
 
-#include <cassert>
+#include <bit>
 #include <cmath>
 #include <cstdint>
-#include <functional>
+#include <cstring>
+#include <memory>
 #include "math/matrix.hpp"
 #include "format/pixel_array/packed.hpp"
+#include "format/pixel_array/rotate.hpp"
 
-matrix<uint8_t> build_packed_pixel_matrix(
-    uint16_t bits_per_pixel,
-    unsigned int width,
-    int height,
-    std::vector<color> & color_table,
-    std::function<uint8_t (unsigned int i, unsigned int j)> get_pixel
-) {
-    assert(bits_per_pixel < 8);
-    int row_size = get_row_size(bits_per_pixel, width);
-    int pixels_per_byte = 8 / bits_per_pixel;
-    
-    matrix<uint8_t> pixels(abs(height), row_size);
-    for (int i = 0; i < abs(height); i++) {
-        std::vector<uint8_t> row(row_size, 0);
-        for (unsigned int j = 0; j < width; j++) {
-            uint8_t ij = get_pixel(i, j);
-            unsigned int byte_index = j / pixels_per_byte;
-            unsigned int pixel_number = j % pixels_per_byte;
-            unsigned int shift = (pixels_per_byte - 1 - pixel_number) * bits_per_pixel;
-            row[byte_index] |= (ij << shift);
+static uint64_t load_be64(const uint8_t * p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    if constexpr (std::endian::native == std::endian::little) {
+        v = std::byteswap(v);
+    }
+    return v;
+}
+
+static void store_be64(uint8_t * p, uint64_t v) {
+    if constexpr (std::endian::native == std::endian::little) {
+        v = std::byteswap(v);
+    }
+    std::memcpy(p, &v, sizeof(v));
+}
+
+void copy_bits(uint8_t * dst, const uint8_t * src, size_t src_size, size_t src_bit, size_t bit_count) {
+    size_t bytes = (bit_count + 7) / 8;
+    const uint8_t * s = src + src_bit / 8;
+    size_t available = src_size - src_bit / 8;
+    unsigned int shift = src_bit % 8;
+
+    if (shift == 0) {
+        std::memcpy(dst, s, bytes);
+    } else {
+        size_t k = 0;
+        // funnel shift: 9 source bytes give 8 destination bytes
+        for (; k + 9 <= available && k + 8 <= bytes; k += 8) {
+            uint64_t word = load_be64(s + k);
+            store_be64(dst + k, (word << shift) | (s[k + 8] >> (8 - shift)));
+        }
+        for (; k < bytes; k++) {
+            uint8_t next = k + 1 < available ? s[k + 1] : 0;
+            dst[k] = static_cast<uint8_t>((s[k] << shift) | (next >> (8 - shift)));
         }
-        pixels.set_row(i, row);
     }
-    return pixels;
+
+    // bits past the last pixel belong to the row padding
+    if (bit_count % 8 != 0) {
+        dst[bytes - 1] &= static_cast<uint8_t>(0xFFu << (8 - bit_count % 8));
+    }
 }
 
 PackedBitmapPixelArray::PackedBitmapPixelArray(uint16_t bits_per_pixel, unsigned int width, int height, std::vector<color> & color_table)
@@ -39,7 +58,7 @@ PackedBitmapPixelArray::PackedBitmapPixelArray(uint16_t bits_per_pixel, unsigned
     , height_signed(height > 0)
     , row_size(get_row_size(bits_per_pixel, width))
     , pixel_array_size_in_bytes(get_pixel_array_size(row_size, height))
-    , pixels(pixel_array_size_in_bytes / row_size, row_size)
+    , pixels(pixel_array_size_in_bytes / row_size, row_size, get_rotation_capacity(bits_per_pixel, width, height))
     , color_table(color_table) {
 }
 
@@ -59,7 +78,20 @@ uint8_t PackedBitmapPixelArray::get_pixel_color_idx(unsigned int i, unsigned int
 
 
 color PackedBitmapPixelArray::get_pixel(unsigned int i, unsigned int j) {
-    return color_table[get_pixel_color_idx(i, j)];
+    return palette_color(color_table, get_pixel_color_idx(i, j));
+}
+
+void PackedBitmapPixelArray::get_row(unsigned int i, color * out, unsigned int first, unsigned int count) {
+    unsigned int rows = pixels.rows();
+    unsigned int row_index = height_signed ? (rows - 1 - i) : i;
+    const uint8_t * p = &pixels(row_index, 0);
+    uint8_t mask = (1u << bits_per_pixel) - 1u;
+
+    for (unsigned int k = 0; k < count; k++) {
+        unsigned int j = first + k;
+        unsigned int shift = (pixels_per_byte - 1 - j % pixels_per_byte) * bits_per_pixel;
+        out[k] = palette_color(color_table, (p[j / pixels_per_byte] >> shift) & mask);
+    }
 }
 
 unsigned int PackedBitmapPixelArray::width() {
@@ -70,42 +102,53 @@ int PackedBitmapPixelArray::height() {
     return h;
 }
 
-void PackedBitmapPixelArray::rotate_90() {
-    int new_h = height_signed ? -((int)w) : (int)w;
-    unsigned int new_w = abs(h);
+void PackedBitmapPixelArray::rotate_90(bool in_place, bool clockwise) {
+    unsigned int rows = abs(h);
+    unsigned int new_w = rows;
+    int new_h = height_signed ? (int)w : -((int)w);
 
     unsigned int new_row_size = get_row_size(bits_per_pixel, new_w);
     unsigned int new_pixel_array_size = get_pixel_array_size(new_row_size, new_h);
 
-    matrix<uint8_t> new_pixels = build_packed_pixel_matrix(bits_per_pixel, new_w, new_h, color_table, [&](unsigned int i, unsigned int j) {
-        return get_pixel_color_idx(new_w - 1 - j, i);
-    });
+    // the visited bits of a non-square in-place rotation would be as large as a 1bpp image
+    bool worth_in_place = in_place && bits_per_pixel > 1;
+
+    // bottom-up rows turn the other way in storage
+    rotate_pixels_90(pixels, BitElements{pixels.data(), bits_per_pixel}, w, rows, clockwise != height_signed, new_row_size, worth_in_place);
 
-    pixels = new_pixels;
     w = new_w;
     h = new_h;
     row_size = new_row_size;
     pixel_array_size_in_bytes = new_pixel_array_size;
-    height_signed = (h > 0);
 }
 
-void PackedBitmapPixelArray::cut(vec2<unsigned int> a, vec2<unsigned int> b) {
+void PackedBitmapPixelArray::rotate_180() {
+    rotate_pixels_180(pixels, BitElements{pixels.data(), bits_per_pixel}, w, static_cast<unsigned int>(abs(h)));
+}
+
+BitmapPixelArray * PackedBitmapPixelArray::crop(vec2<unsigned int> a, vec2<unsigned int> b, std::vector<color> & table) {
     unsigned int new_w = b[0] - a[0] + 1u;
-    int raw_new_h = static_cast<int>(b[1] - a[1] + 1u);
-    int new_h = height_signed ? -raw_new_h : raw_new_h;
+    unsigned int new_rows = b[1] - a[1] + 1u;
+    int new_h = height_signed ? (int)new_rows : -((int)new_rows);
 
-    matrix<uint8_t> new_pixels = build_packed_pixel_matrix(bits_per_pixel, new_w, new_h, color_table, [&](unsigned int i, unsigned int j) {
-        return get_pixel_color_idx(a[1] + i, a[0] + j);
-    });
+    auto * cropped = new PackedBitmapPixelArray(bits_per_pixel, new_w, new_h, table);
 
-    unsigned int new_row_size = get_row_size(bits_per_pixel, new_w);
-    unsigned int new_pixel_array_size = get_pixel_array_size(new_row_size, new_h);
+    // rows keep their order, so a bottom-up cut starts at the bottom of the source too
+    unsigned int first_row = height_signed ? pixels.rows() - 1 - b[1] : a[1];
+    for (unsigned int i = 0; i < new_rows; i++) {
+        copy_bits(&cropped->pixels(i, 0), &pixels(first_row + i, 0), row_size, a[0] * bits_per_pixel, new_w * bits_per_pixel);
+    }
+    return cropped;
+}
 
-    pixels = std::move(new_pixels);
-    w = new_w;
-    h = new_h;
-    row_size = new_row_size;
-    pixel_array_size_in_bytes = new_pixel_array_size;
+void PackedBitmapPixelArray::cut(vec2<unsigned int> a, vec2<unsigned int> b) {
+    std::unique_ptr<PackedBitmapPixelArray> cropped(static_cast<PackedBitmapPixelArray *>(crop(a, b, color_table)));
+
+    pixels = std::move(cropped->pixels);
+    w = cropped->w;
+    h = cropped->h;
+    row_size = cropped->row_size;
+    pixel_array_size_in_bytes = cropped->pixel_array_size_in_bytes;
 }
 
 
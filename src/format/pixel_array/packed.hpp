@@ -1,17 +1,12 @@
 #pragma once
 
 #include <cstdint>
-#include <functional>
 #include "format/pixel_array.hpp"
 #include "math/matrix.hpp"
 
-matrix<uint8_t> build_packed_pixel_matrix(
-    uint16_t bits_per_pixel,
-    unsigned int width,
-    int height,
-    std::vector<color> & color_table,
-    std::function<uint8_t (unsigned int i, unsigned int j)> get_pixel
-);
+// copies bit_count msb-first bits starting at src_bit of a src_size byte row to the start of dst,
+// whole bytes are written and the bits after the last one are cleared
+void copy_bits(uint8_t * dst, const uint8_t * src, size_t src_size, size_t src_bit, size_t bit_count);
 
 class PackedBitmapPixelArray : public BitmapPixelArray {
 public:
@@ -35,10 +30,14 @@ public:
     int height() override;
 
     color get_pixel(unsigned int i, unsigned int j) override;
+    using BitmapPixelArray::get_row;
+    void get_row(unsigned int i, color * out, unsigned int first, unsigned int count) override;
     uint8_t get_pixel_color_idx(unsigned int i, unsigned int j);
 
-    void rotate_90() override;
+    void rotate_90(bool in_place = false, bool clockwise = true) override;
+    void rotate_180() override;
     void cut(vec2<unsigned int> a, vec2<unsigned int> b) override;
+    BitmapPixelArray * crop(vec2<unsigned int> a, vec2<unsigned int> b, std::vector<color> & color_table) override;
 
     uint8_t * data() override;
     size_t byte_size() override;
@@ -0,0 +1,45 @@
+#include <algorithm>
+#include <cstdlib>
+#include "format/row_reader.hpp"
+#include "exceptions.hpp"
+
+BitmapRowReader::BitmapRowReader(const char * path) : input(path, std::ios::binary) {
+    if (!input.is_open()) {
+        throw invalid_file_path(path);
+    }
+    bitmap.read_header(input);
+    pixel_array_offset = bitmap.pixel_array_offset();
+
+    width = static_cast<unsigned int>(bitmap.header.bitmap_width);
+    rows = static_cast<unsigned int>(abs(bitmap.header.bitmap_height));
+    bottom_up = bitmap.header.bitmap_height > 0;
+    row_size = static_cast<size_t>(get_row_size(bitmap.header.bits_per_pixel, width));
+}
+
+unsigned int BitmapRowReader::read_band(unsigned int count) {
+    unsigned int n = std::min(count, rows - next_row);
+    if (n == 0) {
+        return 0;
+    }
+
+    int band_height = bottom_up ? static_cast<int>(n) : -static_cast<int>(n);
+    if (bitmap.pixels == nullptr || bitmap.pixels->height() != band_height) {
+        bitmap.allocate_pixels(width, band_height);
+    }
+
+    // a band is contiguous in the file either way, bottom-up files just store it further back
+    unsigned int first_stored = bottom_up ? rows - next_row - n : next_row;
+    input.seekg(pixel_array_offset + static_cast<std::streamoff>(first_stored * row_size));
+    input.read(reinterpret_cast<char *>(bitmap.pixels->data()), static_cast<std::streamsize>(n * row_size));
+
+    next_row += n;
+    return n;
+}
+
+void BitmapRowReader::seek(unsigned int row) {
+    next_row = std::min(row, rows);
+}
+
+unsigned int BitmapRowReader::band_start() {
+    return next_row - static_cast<unsigned int>(abs(bitmap.pixels->height()));
+}
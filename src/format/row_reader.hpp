@@ -0,0 +1,30 @@
+#pragma once
+
+#include <fstream>
+#include "format/bmp.hpp"
+
+// parses only the headers and then reads pixel rows top to bottom in bands,
+// so a large file is never held in memory at once
+class BitmapRowReader {
+    std::ifstream input;
+    std::streamoff pixel_array_offset;
+    size_t row_size;
+    unsigned int next_row = 0;
+
+public:
+    // headers and color table of the file, pixels hold the last band read
+    Bitmap bitmap;
+    unsigned int width;
+    unsigned int rows;
+    bool bottom_up;
+
+    BitmapRowReader(const char * path);
+
+    // reads up to count rows following the previous band into bitmap.pixels,
+    // row i of the band is row band_start() + i of the image.
+    // returns the number of rows read, 0 once the image is done
+    unsigned int read_band(unsigned int count);
+    // makes the next band start at row
+    void seek(unsigned int row);
+    unsigned int band_start();
+};
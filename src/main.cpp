@@ -1,14 +1,20 @@
 #include <print>
 #include <format>
+#include <iostream>
+#include <memory>
+#include <string>
 #include <string_view>
+#include <vector>
+#include "command.hpp"
 #include "exceptions.hpp"
-#include "format/bmp.hpp"
+#include "server/server.hpp"
 
 using namespace std;
 
 void print_help() {
-    println("Usage: bmpconvert <command> <input> [output]");
-    println("Avaliable commands: -help, -info, -rotate, -inverse, -cut");
+    println("Usage: bmpconvert [options] <command> <input> [output]");
+    println("Avaliable commands: -help, -info, -rotate, -inverse, -adjust, -blur, -convolve, -overlay, -cut, -tile, -tensor, -phash, -stats, -cache-stats");
+    println("Avaliable options: --serve <socket>, --threads <count>, --cache-dir <dir>, --cache-size <MiB>, --in-place");
 }
 
 int main(int argc, char * argv[]) {
@@ -17,49 +23,59 @@ int main(int argc, char * argv[]) {
         return 0;
     }
 
-    std::string_view command_name(argv[1]);
+    vector<string> args(argv + 1, argv + argc);
+    string serve_path;
+    unsigned int threads = 0;
+    string cache_dir;
+    uint64_t cache_size = ResultCache::default_max_bytes;
 
     try {
-        if (command_name == "-info") {
-            if (argc < 3) {
-                print_help();
-                return 0;
+        // options come before the command, all but --in-place take a value
+        CommandOptions options;
+        size_t first = 0;
+        while (first < args.size() && args[first].starts_with("--")) {
+            const string & option = args[first++];
+            if (option == "--in-place") {
+                options.in_place = true;
+                continue;
             }
-            Bitmap bmp(argv[2]);
-            bmp.print_info();
-        } else if (command_name == "-rotate") {
-            if (argc < 5) {
-                print_help();
-                return 1;
+            if (first == args.size()) {
+                throw invalid_usage();
             }
-
-            int deg;
-            try {
-                deg = stoi(argv[2]);
-            } catch (exception & e) {
-                throw invalid_degrees(argv[2]);
-            }
-            Bitmap bmp(argv[3]);
-            bmp.rotate(deg);
-            bmp.write(argv[4]);
-        } else if (command_name == "-inverse") {
-            if (argc < 4) {
-                print_help();
-                return 1;
+            const string & value = args[first++];
+            if (option == "--serve") {
+                serve_path = value;
+            } else if (option == "--threads") {
+                threads = static_cast<unsigned int>(stoul(value));
+            } else if (option == "--cache-dir") {
+                cache_dir = value;
+            } else if (option == "--cache-size") {
+                cache_size = stoull(value) << 20;
+            } else {
+                throw invalid_usage();
             }
-            Bitmap bmp(argv[2]);
-            bmp.inverse_colors();
-            bmp.write(argv[3]);
-        } else if (command_name == "-cut") {
-            vec2 a {stoi(argv[2]), stoi(argv[3])};
-            vec2 b {stoi(argv[4]), stoi(argv[5])};
-            Bitmap bmp(argv[6]);
-            bmp.cut(a, b);
-            bmp.write(argv[7]);
-        } else {
-            print_help();
-            return 1;
         }
+
+        unique_ptr<ResultCache> cache;
+        if (!cache_dir.empty()) {
+            cache = make_unique<ResultCache>(cache_dir, cache_size);
+            options.cache = cache.get();
+        }
+
+        if (!serve_path.empty()) {
+            Server server(serve_path.c_str(), threads, options);
+            server.run();
+            return 0;
+        }
+
+        // threads only start for commands that hand the pool work (-phash, filters on large images);
+        // the server leaves it unset, its workers already run requests side by side
+        ThreadPool pool(threads);
+        options.pool = &pool;
+        run_command(span(args).subspan(first), cout, options);
+    } catch (invalid_usage & e) {
+        print_help();
+        return 1;
     } catch (exception & e) {
         println("{}", e.what());
     }
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <algorithm>
 #include <format>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -12,10 +14,12 @@ class matrix {
     public:
         using reference = T&;
 
-        matrix(unsigned int m, unsigned int n) {
+        // capacity reserves room to reshape() into a larger matrix without reallocating
+        matrix(unsigned int m, unsigned int n, size_t capacity = 0) {
             this->m = m;
             this->n = n;
-            elements = std::vector<T>(m * n);
+            elements.reserve(std::max<size_t>(capacity, size_t(m) * n));
+            elements.resize(size_t(m) * n);
         }
 
         reference operator ()(unsigned int i, unsigned int j) {
@@ -38,6 +42,13 @@ class matrix {
             } 
         }
 
+        // keeps the elements in place, only the dimensions change
+        void reshape(unsigned int m, unsigned int n) {
+            this->m = m;
+            this->n = n;
+            elements.resize(size_t(m) * n);
+        }
+
         T * data() {
             return elements.data();
         }
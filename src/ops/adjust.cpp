@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <format>
+#include "ops/adjust.hpp"
+#include "exceptions.hpp"
+#include "format/pixel_array/expanded.hpp"
+#include "util/parallel.hpp"
+
+namespace {
+    using table = std::array<uint8_t, 256>;
+
+    template<typename F>
+    table make_table(F f) {
+        table t;
+        // clamped before rounding, lround overflows for values past the range of long
+        for (int v = 0; v < 256; v++) {
+            t[v] = static_cast<uint8_t>(std::lround(std::clamp(static_cast<double>(f(static_cast<double>(v))), 0.0, 255.0)));
+        }
+        return t;
+    }
+
+    std::vector<std::string_view> split(std::string_view s, char separator) {
+        std::vector<std::string_view> parts;
+        size_t start = 0;
+        while (start <= s.size()) {
+            size_t end = s.find(separator, start);
+            if (end == std::string_view::npos) {
+                end = s.size();
+            }
+            std::string_view part = s.substr(start, end - start);
+            while (!part.empty() && part.front() == ' ') part.remove_prefix(1);
+            while (!part.empty() && part.back() == ' ') part.remove_suffix(1);
+            if (!part.empty()) {
+                parts.push_back(part);
+            }
+            start = end + 1;
+        }
+        return parts;
+    }
+
+    double number(std::string_view op, std::string_view text) {
+        double value;
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (error != std::errc() || end != text.data() + text.size() || !std::isfinite(value)) {
+            throw invalid_adjustment(op);
+        }
+        return value;
+    }
+
+    uint8_t luma(uint8_t r, uint8_t g, uint8_t b) {
+        return static_cast<uint8_t>((77u * r + 150u * g + 29u * b + 128u) >> 8);
+    }
+}
+
+void PointOps::map_channels(const table & f) {
+    if (stages.empty()) {
+        stages.emplace_back();
+        for (auto & t : stages.back().lut) {
+            t = make_table([](double v) { return v; });
+        }
+    }
+    for (auto & t : stages.back().lut) {
+        for (auto & v : t) {
+            v = f[v];
+        }
+    }
+}
+
+void PointOps::swap_channels(unsigned int a, unsigned int b) {
+    map_channels(make_table([](double v) { return v; }));
+    Stage & stage = stages.back();
+    std::swap(stage.lut[a], stage.lut[b]);
+    std::swap(stage.source[a], stage.source[b]);
+}
+
+void PointOps::read_luma(const table & f) {
+    Stage stage;
+    stage.luma = true;
+    stage.lut = {f, f, f};
+    stages.push_back(stage);
+}
+
+PointOps PointOps::parse(std::string_view chain) {
+    PointOps ops;
+    for (std::string_view op : split(chain, ',')) {
+        std::vector<std::string_view> words = split(op, ' ');
+        std::string_view name = words[0];
+        size_t arity = words.size() - 1;
+        auto arg = [&](size_t i) { return number(op, words[i + 1]); };
+
+        std::string normalized;
+        if (name == "invert" && arity == 0) {
+            ops.map_channels(make_table([](double v) { return 255 - v; }));
+            normalized = "invert";
+        } else if (name == "gamma" && arity == 1 && arg(0) > 0) {
+            double g = arg(0);
+            ops.map_channels(make_table([g](double v) { return 255 * std::pow(v / 255, 1 / g); }));
+            normalized = std::format("gamma {}", g);
+        } else if (name == "levels" && arity == 2 && arg(0) < arg(1)) {
+            double low = arg(0), high = arg(1);
+            ops.map_channels(make_table([=](double v) { return (v - low) * 255 / (high - low); }));
+            normalized = std::format("levels {} {}", low, high);
+        } else if (name == "contrast" && arity == 1) {
+            double factor = arg(0);
+            ops.map_channels(make_table([factor](double v) { return (v - 127.5) * factor + 127.5; }));
+            normalized = std::format("contrast {}", factor);
+        } else if (name == "brightness" && arity == 1) {
+            double delta = arg(0);
+            ops.map_channels(make_table([delta](double v) { return v + delta; }));
+            normalized = std::format("brightness {}", delta);
+        } else if (name == "grayscale" && arity == 0) {
+            ops.read_luma(make_table([](double v) { return v; }));
+            normalized = "grayscale";
+        } else if (name == "threshold" && arity == 1) {
+            double t = arg(0);
+            ops.read_luma(make_table([t](double v) { return v >= t ? 255 : 0; }));
+            normalized = std::format("threshold {}", t);
+        } else if (name == "swap" && arity == 1 && words[1].size() == 2) {
+            auto channel = [&](char c) -> unsigned int {
+                switch (c) {
+                    case 'r': return 0;
+                    case 'g': return 1;
+                    case 'b': return 2;
+                }
+                throw invalid_adjustment(op);
+            };
+            unsigned int a = channel(words[1][0]), b = channel(words[1][1]);
+            if (a == b) {
+                throw invalid_adjustment(op);
+            }
+            ops.swap_channels(std::min(a, b), std::max(a, b));
+            normalized = std::format("swap {}{}", "rgb"[std::min(a, b)], "rgb"[std::max(a, b)]);
+        } else {
+            throw invalid_adjustment(op);
+        }
+
+        if (!ops.description.empty()) {
+            ops.description += ", ";
+        }
+        ops.description += normalized;
+    }
+    if (ops.stages.empty()) {
+        throw invalid_adjustment(chain);
+    }
+    return ops;
+}
+
+color PointOps::apply(color c) const {
+    for (const Stage & stage : stages) {
+        if (stage.luma) {
+            uint8_t y = luma(c[0], c[1], c[2]);
+            c = {stage.lut[0][y], stage.lut[1][y], stage.lut[2][y], c[3]};
+        } else {
+            c = {stage.lut[0][c[stage.source[0]]], stage.lut[1][c[stage.source[1]]], stage.lut[2][c[stage.source[2]]], c[3]};
+        }
+    }
+    return c;
+}
+
+// O(palette) regardless of image size
+void PointOps::apply_palette(Bitmap & bmp) const {
+    for (auto & entry : bmp.color_table) {
+        // palette entries are stored as b, g, r, reserved
+        color c = apply(color{entry[2], entry[1], entry[0], 255});
+        entry = {c[2], c[1], c[0], entry[3]};
+    }
+}
+
+// the whole chain becomes one 65536 entry table
+void PointOps::apply_16bit(Bitmap & bmp, ThreadPool * pool) const {
+    auto * pixels = static_cast<ExpandedBitmapPixelArray *>(bmp.pixels);
+    std::vector<uint16_t> lut(1u << 16);
+    for (uint32_t v = 0; v < lut.size(); v++) {
+        lut[v] = pixels->color_to_16bit(apply(pixels->color_from_16bit(static_cast<uint16_t>(v))));
+    }
+
+    unsigned int rows = static_cast<unsigned int>(std::abs(pixels->height()));
+    unsigned int width = pixels->width();
+    size_t row_size = static_cast<size_t>(pixels->row_byte_size());
+    uint8_t * data = pixels->data();
+    parallel_rows(pool, rows, row_size, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int r = begin; r < end; r++) {
+            uint8_t * p = data + r * row_size;
+            for (unsigned int j = 0; j < width; j++, p += 2) {
+                uint16_t v = lut[p[0] | (p[1] << 8)];
+                p[0] = static_cast<uint8_t>(v & 0xFFu);
+                p[1] = static_cast<uint8_t>(v >> 8);
+            }
+        }
+    });
+}
+
+// one pass over b, g, r(, a) rows
+void PointOps::apply_direct(Bitmap & bmp, ThreadPool * pool) const {
+    BitmapPixelArray * pixels = bmp.pixels;
+    unsigned int rows = static_cast<unsigned int>(std::abs(pixels->height()));
+    unsigned int width = pixels->width();
+    unsigned int bytes_per_pixel = bmp.header.bits_per_pixel / 8;
+    size_t row_size = static_cast<size_t>(pixels->row_byte_size());
+    uint8_t * data = pixels->data();
+
+    const Stage & first = stages.front();
+    bool plain_tables = stages.size() == 1 && !first.luma && first.source == std::array<uint8_t, 3>{0, 1, 2};
+
+    parallel_rows(pool, rows, row_size, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int r = begin; r < end; r++) {
+            uint8_t * p = data + r * row_size;
+            if (plain_tables) {
+                // the common case: byte lookups, no decoding
+                const table & lut_b = first.lut[2];
+                const table & lut_g = first.lut[1];
+                const table & lut_r = first.lut[0];
+                for (unsigned int j = 0; j < width; j++, p += bytes_per_pixel) {
+                    p[0] = lut_b[p[0]];
+                    p[1] = lut_g[p[1]];
+                    p[2] = lut_r[p[2]];
+                }
+            } else {
+                for (unsigned int j = 0; j < width; j++, p += bytes_per_pixel) {
+                    color c = apply(color{p[2], p[1], p[0], 255});
+                    p[0] = c[2];
+                    p[1] = c[1];
+                    p[2] = c[0];
+                }
+            }
+        }
+    });
+}
+
+void PointOps::apply(Bitmap & bmp, ThreadPool * pool) const {
+    uint16_t bits_per_pixel = bmp.header.bits_per_pixel;
+    if (bits_per_pixel <= 8) {
+        apply_palette(bmp);
+    } else if (bits_per_pixel == 16) {
+        apply_16bit(bmp, pool);
+    } else {
+        apply_direct(bmp, pool);
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "format/bmp.hpp"
+#include "util/thread_pool.hpp"
+
+// a chain of point operations, e.g. "gamma 2.2, levels 10 240, invert".
+// per-channel operations and channel swaps fold into one lookup table per channel,
+// grayscale and threshold start a new stage that reads luma instead.
+// supported: invert, gamma <g>, levels <low> <high>, contrast <factor>, brightness <delta>,
+// grayscale, threshold <t>, swap rg|rb|gb
+class PointOps {
+    using table = std::array<uint8_t, 256>;
+
+    struct Stage {
+        bool luma = false;
+        std::array<uint8_t, 3> source {0, 1, 2}; // input channel per output channel, unused for luma
+        std::array<table, 3> lut;
+    };
+
+    std::vector<Stage> stages;
+    std::string description;
+
+    void map_channels(const table & f);
+    void swap_channels(unsigned int a, unsigned int b);
+    void read_luma(const table & f);
+
+    void apply_palette(Bitmap & bmp) const;
+    void apply_16bit(Bitmap & bmp, ThreadPool * pool) const;
+    void apply_direct(Bitmap & bmp, ThreadPool * pool) const;
+
+public:
+    static PointOps parse(std::string_view chain);
+
+    // rgba in, rgba out, alpha is kept
+    color apply(color c) const;
+    // rows are split into bands on pool, or mapped on the calling thread without one
+    void apply(Bitmap & bmp, ThreadPool * pool) const;
+
+    // normalized chain, equal for equivalent spellings
+    const std::string & normalized() const { return description; }
+};
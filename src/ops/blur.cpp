@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include "ops/blur.hpp"
+#include "exceptions.hpp"
+#include "util/parallel.hpp"
+
+namespace {
+    constexpr int fraction_bits = 14;
+    constexpr unsigned int max_taps = 31;
+    // largest normalized weight, 16.0 in fixed point, so max_taps * 255 * weight stays within int32
+    constexpr double max_weight = 16 << fraction_bits;
+
+    // vertical passes walk columns this many bytes wide, so a strip of every row stays in cache
+    constexpr unsigned int strip_bytes = 256;
+
+    struct Plane {
+        uint8_t * data;
+        size_t stride;
+        unsigned int rows;
+        unsigned int width;
+        unsigned int channels;
+    };
+
+    Plane direct_plane(Bitmap & bmp) {
+        if (bmp.header.bits_per_pixel < 24) {
+            bmp.expand_to(24);
+        }
+        return Plane {
+            bmp.pixels->data(),
+            static_cast<size_t>(bmp.pixels->row_byte_size()),
+            static_cast<unsigned int>(abs(bmp.pixels->height())),
+            bmp.pixels->width(),
+            static_cast<unsigned int>(bmp.header.bits_per_pixel / 8)
+        };
+    }
+
+    // n / d rounded, as a multiply by the reciprocal
+    struct Divider {
+        uint64_t multiplier;
+        explicit Divider(unsigned int d) : multiplier(((uint64_t(1) << 32) + d / 2) / d) {}
+        uint8_t operator()(uint32_t n) const {
+            return static_cast<uint8_t>((n * multiplier + (uint64_t(1) << 31)) >> 32);
+        }
+    };
+
+    uint8_t fixed_to_byte(int32_t v) {
+        return static_cast<uint8_t>(std::clamp((v + (1 << (fraction_bits - 1))) >> fraction_bits, 0, 255));
+    }
+
+    // row with radius pixels repeated on both sides and one spare pixel for the sliding sum
+    void pad_row(const uint8_t * row, const Plane & p, unsigned int radius, std::vector<uint8_t> & padded) {
+        unsigned int c = p.channels;
+        padded.resize((size_t(p.width) + 2 * radius + 1) * c);
+        for (unsigned int k = 0; k < radius; k++) {
+            std::memcpy(&padded[k * c], row, c);
+        }
+        std::memcpy(&padded[size_t(radius) * c], row, size_t(p.width) * c);
+        for (unsigned int k = radius + p.width; k < p.width + 2 * radius + 1; k++) {
+            std::memcpy(&padded[size_t(k) * c], row + size_t(p.width - 1) * c, c);
+        }
+    }
+
+    // rows are independent, so bands of them go to the pool
+    template<typename F>
+    void horizontal_pass(const Plane & p, ThreadPool * pool, F filter_row) {
+        parallel_rows(pool, p.rows, p.stride, [&](unsigned int begin, unsigned int end) {
+            std::vector<uint8_t> padded;
+            for (unsigned int i = begin; i < end; i++) {
+                filter_row(p.data + i * p.stride, padded);
+            }
+        });
+    }
+
+    // columns are independent too; filters keep their own copy of what they still need
+    // of a strip, since the rows above the current one are already overwritten
+    template<typename F>
+    void vertical_pass(const Plane & p, ThreadPool * pool, F filter_strip) {
+        unsigned int bytes = p.width * p.channels;
+        unsigned int strips = (bytes + strip_bytes - 1) / strip_bytes;
+        for_each_band(pool, strips, std::min(strips, band_count(pool, p.rows, p.stride)), [&](unsigned int, unsigned int begin, unsigned int end) {
+            std::vector<uint8_t> buffer;
+            for (unsigned int s = begin; s < end; s++) {
+                unsigned int x = s * strip_bytes;
+                filter_strip(x, std::min(strip_bytes, bytes - x), buffer);
+            }
+        });
+    }
+
+    const uint8_t * source_row(const Plane & p, int i, unsigned int x) {
+        return p.data + size_t(std::clamp(i, 0, static_cast<int>(p.rows) - 1)) * p.stride + x;
+    }
+
+    // fills window with rows -radius .. radius as they were
+    void fill_window(const Plane & p, unsigned int x, unsigned int n, unsigned int radius, std::vector<uint8_t> & window) {
+        window.resize(size_t(2 * radius + 1) * n);
+        for (unsigned int k = 0; k < 2 * radius + 1; k++) {
+            std::memcpy(&window[size_t(k) * n], source_row(p, static_cast<int>(k) - static_cast<int>(radius), x), n);
+        }
+    }
+
+    // running sums make a box cost the same for any radius. pixels past the edges repeat the edge pixel,
+    // they are counted into the first sum rather than copied
+    void box_blur(const Plane & p, const std::vector<unsigned int> & radii, ThreadPool * pool) {
+        horizontal_pass(p, pool, [&](uint8_t * row, std::vector<uint8_t> & source) {
+            unsigned int c = p.channels;
+            unsigned int last = p.width - 1;
+            for (unsigned int radius : radii) {
+                source.assign(row, row + size_t(p.width) * c);
+                Divider divide(2 * radius + 1);
+                unsigned int inside = std::min(radius, last);
+                uint32_t sum[4] = {};
+                for (unsigned int ch = 0; ch < c; ch++) {
+                    sum[ch] = (radius + 1) * source[ch] + (radius - inside) * source[size_t(last) * c + ch];
+                    for (unsigned int k = 1; k <= inside; k++) {
+                        sum[ch] += source[size_t(k) * c + ch];
+                    }
+                }
+                for (unsigned int j = 0; j < p.width; j++) {
+                    const uint8_t * entering = &source[size_t(std::min(j + radius + 1, last)) * c];
+                    const uint8_t * leaving = &source[size_t(j > radius ? j - radius : 0) * c];
+                    for (unsigned int ch = 0; ch < c; ch++) {
+                        row[size_t(j) * c + ch] = divide(sum[ch]);
+                        sum[ch] += entering[ch] - leaving[ch];
+                    }
+                }
+            }
+        });
+
+        vertical_pass(p, pool, [&](unsigned int x, unsigned int n, std::vector<uint8_t> & source) {
+            std::vector<uint32_t> sum(n);
+            unsigned int last = p.rows - 1;
+            for (unsigned int radius : radii) {
+                source.resize(size_t(p.rows) * n);
+                for (unsigned int i = 0; i < p.rows; i++) {
+                    std::memcpy(&source[size_t(i) * n], p.data + i * p.stride + x, n);
+                }
+                Divider divide(2 * radius + 1);
+                unsigned int inside = std::min(radius, last);
+                const uint8_t * top = source.data();
+                const uint8_t * bottom = &source[size_t(last) * n];
+                for (unsigned int b = 0; b < n; b++) {
+                    sum[b] = (radius + 1) * top[b] + (radius - inside) * bottom[b];
+                }
+                for (unsigned int k = 1; k <= inside; k++) {
+                    for (unsigned int b = 0; b < n; b++) {
+                        sum[b] += source[size_t(k) * n + b];
+                    }
+                }
+
+                for (unsigned int i = 0; i < p.rows; i++) {
+                    uint8_t * out = p.data + i * p.stride + x;
+                    const uint8_t * entering = &source[size_t(std::min(i + radius + 1, last)) * n];
+                    const uint8_t * leaving = &source[size_t(i > radius ? i - radius : 0) * n];
+                    for (unsigned int b = 0; b < n; b++) {
+                        out[b] = divide(sum[b]);
+                        sum[b] += entering[b] - leaving[b];
+                    }
+                }
+            }
+        });
+    }
+
+    // box radii whose repeated blur best matches a gaussian of the given sigma
+    std::vector<unsigned int> gaussian_boxes(double sigma, unsigned int passes) {
+        double ideal = std::sqrt(12.0 * sigma * sigma / passes + 1.0);
+        int lower = static_cast<int>(std::floor(ideal));
+        if (lower % 2 == 0) {
+            lower--;
+        }
+        int upper = lower + 2;
+        int n = static_cast<int>(passes);
+        long lower_count = std::lround((12.0 * sigma * sigma - n * lower * lower - 4.0 * n * lower - 3.0 * n) / (-4.0 * lower - 4.0));
+
+        std::vector<unsigned int> radii;
+        for (int i = 0; i < n; i++) {
+            radii.push_back(static_cast<unsigned int>(((i < lower_count ? lower : upper) - 1) / 2));
+        }
+        return radii;
+    }
+
+    std::vector<std::string_view> words(std::string_view s) {
+        std::vector<std::string_view> parts;
+        size_t start = 0;
+        while ((start = s.find_first_not_of(' ', start)) != std::string_view::npos) {
+            size_t end = std::min(s.find(' ', start), s.size());
+            parts.push_back(s.substr(start, end - start));
+            start = end;
+        }
+        return parts;
+    }
+}
+
+void blur(Bitmap & bmp, unsigned int radius, bool gaussian, ThreadPool * pool) {
+    if (radius == 0) {
+        return;
+    }
+    // anything wider already averages the whole image, only slower
+    unsigned int limit = std::max(bmp.pixels->width(), static_cast<unsigned int>(abs(bmp.pixels->height())));
+    if (radius > limit) {
+        throw invalid_radius(radius, limit);
+    }
+    box_blur(direct_plane(bmp), gaussian ? gaussian_boxes(radius, 3) : std::vector<unsigned int> {radius}, pool);
+}
+
+SeparableKernel SeparableKernel::parse(std::string_view text) {
+    SeparableKernel kernel;
+    std::array<std::vector<double>, 2> taps;
+
+    size_t slash = text.find('/');
+    std::array<std::string_view, 2> parts {text.substr(0, slash), slash == std::string_view::npos ? text : text.substr(slash + 1)};
+    for (int d = 0; d < 2; d++) {
+        for (std::string_view word : words(parts[d])) {
+            double value;
+            auto [end, error] = std::from_chars(word.data(), word.data() + word.size(), value);
+            if (error != std::errc() || end != word.data() + word.size() || !std::isfinite(value)) {
+                throw invalid_kernel(text);
+            }
+            taps[d].push_back(value);
+        }
+        if (taps[d].size() % 2 == 0 || taps[d].size() > max_taps) {
+            throw invalid_kernel(text);
+        }
+
+        double sum = 0;
+        for (double t : taps[d]) {
+            sum += t;
+        }
+        if (!std::isfinite(sum)) {
+            throw invalid_kernel(text);
+        }
+        double scale = (sum == 0 ? 1.0 : 1.0 / sum) * (1 << fraction_bits);
+        for (double t : taps[d]) {
+            if (!(std::abs(t * scale) <= max_weight)) {
+                throw invalid_kernel(text);
+            }
+            kernel.weights[d].push_back(static_cast<int32_t>(std::lround(t * scale)));
+        }
+    }
+
+    for (int d = 0; d < 2; d++) {
+        if (d == 1) {
+            if (kernel.weights[1] == kernel.weights[0]) {
+                break;
+            }
+            kernel.description += " /";
+        }
+        for (double t : taps[d]) {
+            kernel.description += kernel.description.empty() ? std::format("{}", t) : std::format(" {}", t);
+        }
+    }
+    return kernel;
+}
+
+void SeparableKernel::apply(Bitmap & bmp, ThreadPool * pool) const {
+    Plane p = direct_plane(bmp);
+
+    const std::vector<int32_t> & horizontal = weights[0];
+    unsigned int h_radius = static_cast<unsigned int>(horizontal.size() / 2);
+    horizontal_pass(p, pool, [&](uint8_t * row, std::vector<uint8_t> & padded) {
+        pad_row(row, p, h_radius, padded);
+        // tap by tap over the whole row keeps the inner loop contiguous
+        std::vector<int32_t> sum(size_t(p.width) * p.channels, 0);
+        for (size_t k = 0; k < horizontal.size(); k++) {
+            const uint8_t * in = padded.data() + k * p.channels;
+            for (size_t b = 0; b < sum.size(); b++) {
+                sum[b] += horizontal[k] * in[b];
+            }
+        }
+        for (size_t b = 0; b < sum.size(); b++) {
+            row[b] = fixed_to_byte(sum[b]);
+        }
+    });
+
+    // bottom-up storage runs the vertical kernel the other way round
+    std::vector<int32_t> vertical = weights[1];
+    if (bmp.pixels->height() > 0) {
+        std::reverse(vertical.begin(), vertical.end());
+    }
+    unsigned int v_radius = static_cast<unsigned int>(vertical.size() / 2);
+    unsigned int taps = static_cast<unsigned int>(vertical.size());
+    vertical_pass(p, pool, [&](unsigned int x, unsigned int n, std::vector<uint8_t> & window) {
+        fill_window(p, x, n, v_radius, window);
+        std::vector<int32_t> sum(n);
+        unsigned int oldest = 0;
+        for (unsigned int i = 0; i < p.rows; i++) {
+            std::fill(sum.begin(), sum.end(), 0);
+            for (unsigned int k = 0; k < taps; k++) {
+                const uint8_t * in = &window[size_t((oldest + k) % taps) * n];
+                for (unsigned int b = 0; b < n; b++) {
+                    sum[b] += vertical[k] * in[b];
+                }
+            }
+            uint8_t * out = p.data + i * p.stride + x;
+            for (unsigned int b = 0; b < n; b++) {
+                out[b] = fixed_to_byte(sum[b]);
+            }
+            if (i + 1 == p.rows) {
+                break;
+            }
+            std::memcpy(&window[size_t(oldest) * n], source_row(p, static_cast<int>(i + v_radius + 1), x), n);
+            oldest = (oldest + 1) % taps;
+        }
+    });
+}
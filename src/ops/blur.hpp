@@ -0,0 +1,30 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "format/bmp.hpp"
+#include "util/thread_pool.hpp"
+
+// box blur over a (2 * radius + 1) square, or a gaussian with sigma = radius approximated by three box blurs.
+// radius may not exceed the larger image side. indexed and 16bpp images become 24bpp,
+// 32bpp alpha is blurred like the colors. both passes run in bands on pool if one is given
+void blur(Bitmap & bmp, unsigned int radius, bool gaussian, ThreadPool * pool);
+
+// a separable kernel: "1 2 1" filters both ways, "1 2 1 / -1 0 1" gives the horizontal and the vertical one.
+// odd lengths up to 31, weights are normalized by their sum unless it is 0 and may not exceed 16 after that.
+// edges repeat the outermost pixels, results are clamped after each pass
+class SeparableKernel {
+    std::array<std::vector<int32_t>, 2> weights; // fixed point, horizontal then vertical, first tap is up/left
+    std::string description;
+
+public:
+    static SeparableKernel parse(std::string_view text);
+
+    void apply(Bitmap & bmp, ThreadPool * pool) const;
+
+    // normalized text, equal for equivalent spellings
+    const std::string & normalized() const { return description; }
+};
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include "ops/overlay.hpp"
+#include "util/parallel.hpp"
+
+namespace {
+    // exact round(v / 255) for v <= 255 * 255, in 16 bits so the blend loops vectorize 8 or 16 lanes wide
+    inline uint16_t div255(uint16_t v) {
+        v = static_cast<uint16_t>(v + 128);
+        return static_cast<uint16_t>((v + (v >> 8)) >> 8);
+    }
+
+    // spreads 4-byte top pixels, r, g, b, a or b, g, r, a as stored in 32bpp bitmaps, into the base's
+    // b, g, r(, a) byte order with each pixel's alpha repeated per byte, so the blend below is one flat loop
+    // over bytes whatever the pixel size. a 32bpp base gets its alpha as a + (1 - a) * base alpha,
+    // which both blend formulas produce for top 255 (straight) or top a (premultiplied)
+    template<unsigned int BytesPerPixel, bool Premultiplied, bool Bgra>
+    void spread(const uint8_t * top, unsigned int count, uint8_t * values, uint8_t * alphas) {
+        for (unsigned int j = 0; j < count; j++, top += 4, values += BytesPerPixel, alphas += BytesPerPixel) {
+            uint8_t a = top[3];
+            values[0] = top[Bgra ? 0 : 2];
+            values[1] = top[1];
+            values[2] = top[Bgra ? 2 : 0];
+            alphas[0] = alphas[1] = alphas[2] = a;
+            if constexpr (BytesPerPixel == 4) {
+                values[3] = Premultiplied ? a : uint8_t(255);
+                alphas[3] = a;
+            }
+        }
+    }
+
+    template<bool Premultiplied>
+    void blend_bytes(uint8_t * __restrict base, const uint8_t * __restrict values, const uint8_t * __restrict alphas, size_t n) {
+        for (size_t k = 0; k < n; k++) {
+            uint16_t a = alphas[k];
+            uint16_t inverse = static_cast<uint16_t>(255 - a);
+            uint16_t mixed = Premultiplied
+                ? std::min<uint16_t>(255, static_cast<uint16_t>(values[k] + div255(static_cast<uint16_t>(base[k] * inverse))))
+                : div255(static_cast<uint16_t>(values[k] * a + base[k] * inverse));
+            base[k] = static_cast<uint8_t>(mixed);
+        }
+    }
+
+    // blends count top pixels into bgr(a) base bytes, scratch holds the spread top
+    template<unsigned int BytesPerPixel, bool Premultiplied>
+    void blend_span(uint8_t * base, const uint8_t * top, bool bgra, unsigned int count, std::vector<uint8_t> & scratch) {
+        size_t n = size_t(count) * BytesPerPixel;
+        scratch.resize(2 * n);
+        if (bgra) {
+            spread<BytesPerPixel, Premultiplied, true>(top, count, scratch.data(), scratch.data() + n);
+        } else {
+            spread<BytesPerPixel, Premultiplied, false>(top, count, scratch.data(), scratch.data() + n);
+        }
+        blend_bytes<Premultiplied>(base, scratch.data(), scratch.data() + n, n);
+    }
+}
+
+void overlay(Bitmap & base, Bitmap & top, int x, int y, bool premultiplied, ThreadPool * pool) {
+    if (base.header.bits_per_pixel < 24) {
+        base.expand_to(24);
+    }
+
+    int64_t base_w = base.pixels->width();
+    int64_t base_rows = std::abs(base.pixels->height());
+    int64_t top_w = top.pixels->width();
+    int64_t top_rows = std::abs(top.pixels->height());
+
+    // overlapping rectangle in base coordinates, 64-bit since offsets may come close to INT_MAX
+    int64_t x0 = std::max<int64_t>(x, 0), x1 = std::min(x + top_w, base_w);
+    int64_t y0 = std::max<int64_t>(y, 0), y1 = std::min(y + top_rows, base_rows);
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    unsigned int bytes_per_pixel = base.header.bits_per_pixel / 8;
+    size_t row_size = static_cast<size_t>(base.pixels->row_byte_size());
+    uint8_t * data = base.pixels->data();
+    bool bottom_up = base.pixels->height() > 0;
+    unsigned int span = static_cast<unsigned int>(x1 - x0);
+
+    auto kernel = bytes_per_pixel == 4
+        ? (premultiplied ? &blend_span<4, true> : &blend_span<4, false>)
+        : (premultiplied ? &blend_span<3, true> : &blend_span<3, false>);
+
+    // only the overlapping columns of top are read. 32bpp tops with alpha already hold b, g, r, a
+    // and are blended from their storage, other formats are decoded first
+    unsigned int top_first = static_cast<unsigned int>(x0 - x);
+    bool top_bgra = top.header.bits_per_pixel == 32 && top.header.alpha_channel_bitmask != 0;
+    size_t top_row_size = static_cast<size_t>(top.pixels->row_byte_size());
+    bool top_bottom_up = top.pixels->height() > 0;
+    static_assert(sizeof(color) == 4);
+
+    parallel_rows(pool, static_cast<unsigned int>(y1 - y0), span * bytes_per_pixel, [&](unsigned int begin, unsigned int end) {
+        std::vector<color> top_row(top_bgra ? 0 : span);
+        std::vector<uint8_t> scratch;
+        for (unsigned int k = begin; k < end; k++) {
+            int64_t row = y0 + k;
+            unsigned int top_i = static_cast<unsigned int>(row - y);
+            const uint8_t * source;
+            if (top_bgra) {
+                size_t storage = top_bottom_up ? static_cast<size_t>(top_rows - 1 - top_i) : top_i;
+                source = top.pixels->data() + storage * top_row_size + size_t(top_first) * 4;
+            } else {
+                top.pixels->get_row(top_i, top_row.data(), top_first, span);
+                source = reinterpret_cast<const uint8_t *>(top_row.data());
+            }
+
+            size_t storage_row = static_cast<size_t>(bottom_up ? base_rows - 1 - row : row);
+            uint8_t * p = data + storage_row * row_size + static_cast<size_t>(x0) * bytes_per_pixel;
+            kernel(p, source, top_bgra, span, scratch);
+        }
+    });
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "format/bmp.hpp"
+#include "util/thread_pool.hpp"
+
+// alpha-blends top onto base with top's upper left corner at (x, y), offsets may be negative.
+// indexed and 16bpp bases become 24bpp; only 32bpp tops carry alpha, others are pasted opaque.
+// premultiplied tells that top's colors are already multiplied by its alpha.
+void overlay(Bitmap & base, Bitmap & top, int x, int y, bool premultiplied, ThreadPool * pool);
@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <format>
+#include <fstream>
+#include <latch>
+#include <mutex>
+#include <numbers>
+#include <vector>
+#include "ops/phash.hpp"
+#include "exceptions.hpp"
+#include "format/row_reader.hpp"
+#include "util/thread_pool.hpp"
+
+namespace {
+    constexpr size_t band_bytes = 256 * 1024;
+
+    // paths handed to one job, and jobs queued before waiting for them
+    constexpr size_t files_per_job = 16;
+    constexpr size_t jobs_per_thread = 8;
+
+    // mean luma of each cell of a width x height grid laid over the image
+    std::vector<double> grayscale_grid(const char * path, unsigned int width, unsigned int height) {
+        BitmapRowReader reader(path);
+        if (reader.width == 0 || reader.rows == 0) {
+            throw unsupported_bitmap("empty image");
+        }
+
+        std::vector<unsigned int> column_cell(reader.width);
+        std::vector<uint64_t> column_count(width, 0), row_count(height, 0);
+        for (unsigned int j = 0; j < reader.width; j++) {
+            column_cell[j] = static_cast<unsigned int>(uint64_t(j) * width / reader.width);
+            column_count[column_cell[j]]++;
+        }
+
+        std::vector<uint64_t> sums(size_t(width) * height, 0);
+        std::vector<color> row(reader.width);
+        unsigned int band = static_cast<unsigned int>(std::max<size_t>(1, band_bytes / get_row_size(reader.bitmap.header.bits_per_pixel, reader.width)));
+        while (unsigned int band_rows = reader.read_band(band)) {
+            unsigned int first = reader.band_start();
+            for (unsigned int i = 0; i < band_rows; i++) {
+                unsigned int y = static_cast<unsigned int>(uint64_t(first + i) * height / reader.rows);
+                row_count[y]++;
+                reader.bitmap.pixels->get_row(i, row.data());
+                uint64_t * cells = &sums[size_t(y) * width];
+                for (unsigned int j = 0; j < reader.width; j++) {
+                    cells[column_cell[j]] += 77u * row[j][0] + 150u * row[j][1] + 29u * row[j][2];
+                }
+            }
+        }
+
+        // images smaller than the grid leave cells empty, those repeat the cell before
+        std::vector<double> grid(sums.size());
+        for (unsigned int y = 0; y < height; y++) {
+            unsigned int source_y = y;
+            while (row_count[source_y] == 0) source_y--;
+            for (unsigned int x = 0; x < width; x++) {
+                unsigned int source_x = x;
+                while (column_count[source_x] == 0) source_x--;
+                double count = static_cast<double>(row_count[source_y] * column_count[source_x]) * 256.0;
+                grid[size_t(y) * width + x] = static_cast<double>(sums[size_t(source_y) * width + source_x]) / count;
+            }
+        }
+        return grid;
+    }
+
+    uint64_t bits_above(const std::vector<double> & values, double threshold) {
+        uint64_t hash = 0;
+        for (double v : values) {
+            hash = (hash << 1) | (v > threshold ? 1u : 0u);
+        }
+        return hash;
+    }
+
+    // dct-ii basis for the 8 lowest of 32 frequencies
+    const std::array<std::array<double, 32>, 8> & dct_basis() {
+        static const auto basis = [] {
+            std::array<std::array<double, 32>, 8> b;
+            for (int k = 0; k < 8; k++) {
+                for (int n = 0; n < 32; n++) {
+                    b[k][n] = std::cos(std::numbers::pi * (2 * n + 1) * k / 64.0);
+                }
+            }
+            return b;
+        }();
+        return basis;
+    }
+
+    uint64_t dct_hash(const std::vector<double> & grid) {
+        const auto & basis = dct_basis();
+
+        // rows first, then the columns of the 32x8 result
+        std::array<std::array<double, 8>, 32> rows {};
+        for (int y = 0; y < 32; y++) {
+            for (int k = 0; k < 8; k++) {
+                for (int x = 0; x < 32; x++) {
+                    rows[y][k] += grid[y * 32 + x] * basis[k][x];
+                }
+            }
+        }
+        std::vector<double> low(64, 0.0);
+        for (int l = 0; l < 8; l++) {
+            for (int k = 0; k < 8; k++) {
+                for (int y = 0; y < 32; y++) {
+                    low[l * 8 + k] += rows[y][k] * basis[l][y];
+                }
+            }
+        }
+
+        std::vector<double> sorted = low;
+        std::nth_element(sorted.begin(), sorted.begin() + 32, sorted.end());
+        double upper = sorted[32];
+        double median = (*std::max_element(sorted.begin(), sorted.begin() + 32) + upper) / 2;
+        return bits_above(low, median);
+    }
+}
+
+uint64_t perceptual_hash(const char * path, HashKind kind) {
+    switch (kind) {
+        case HashKind::average: {
+            std::vector<double> grid = grayscale_grid(path, 8, 8);
+            double mean = 0;
+            for (double v : grid) {
+                mean += v;
+            }
+            return bits_above(grid, mean / 64);
+        }
+        case HashKind::difference: {
+            std::vector<double> grid = grayscale_grid(path, 9, 8);
+            uint64_t hash = 0;
+            for (int y = 0; y < 8; y++) {
+                for (int x = 0; x < 8; x++) {
+                    hash = (hash << 1) | (grid[y * 9 + x + 1] > grid[y * 9 + x] ? 1u : 0u);
+                }
+            }
+            return hash;
+        }
+        case HashKind::dct:
+            return dct_hash(grayscale_grid(path, 32, 32));
+    }
+    return 0;
+}
+
+// one output line, errors included, so a bad file does not stop the others
+static std::string hash_line(const std::string & path, HashKind kind) {
+    try {
+        return std::format("{}\t{:016x}\n", path, perceptual_hash(path.c_str(), kind));
+    } catch (std::exception & e) {
+        return std::format("{}\terror: {}\n", path, e.what());
+    }
+}
+
+void hash_files(std::span<const std::string> inputs, HashKind kind, ThreadPool * pool, std::ostream & output) {
+    std::mutex output_mutex;
+    std::vector<std::string> pending;
+
+    auto run_pending = [&] {
+        if (pool == nullptr) {
+            for (const std::string & path : pending) {
+                output << hash_line(path, kind);
+            }
+            pending.clear();
+            return;
+        }
+
+        // the pool may be shared, so wait for these jobs only rather than for the whole pool
+        size_t jobs = (pending.size() + files_per_job - 1) / files_per_job;
+        std::latch done(static_cast<std::ptrdiff_t>(jobs));
+        for (size_t start = 0; start < pending.size(); start += files_per_job) {
+            size_t end = std::min(pending.size(), start + files_per_job);
+            pool->submit([&, start, end] {
+                std::string lines;
+                for (size_t i = start; i < end; i++) {
+                    lines += hash_line(pending[i], kind);
+                }
+                {
+                    std::lock_guard lock(output_mutex);
+                    output << lines;
+                }
+                done.count_down();
+            });
+        }
+        done.wait();
+        pending.clear();
+    };
+
+    // long lists go through the pool in slices, so they are never all queued at once
+    size_t slice = (pool ? pool->size() : 1) * jobs_per_thread * files_per_job;
+    auto add = [&](std::string path) {
+        pending.push_back(std::move(path));
+        if (pending.size() == slice) {
+            run_pending();
+        }
+    };
+
+    for (const std::string & input : inputs) {
+        if (!input.starts_with("@")) {
+            add(input);
+            continue;
+        }
+        std::ifstream list(input.substr(1));
+        if (!list.is_open()) {
+            throw invalid_file_path(input.c_str() + 1);
+        }
+        std::string line;
+        while (std::getline(list, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (!line.empty()) {
+                add(line);
+            }
+        }
+    }
+    run_pending();
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string>
+#include "util/thread_pool.hpp"
+
+// average compares an 8x8 grid to its mean, difference compares neighbours in a 9x8 grid,
+// dct compares the lowest 8x8 frequencies of a 32x32 grid to their median
+enum class HashKind { average, difference, dct };
+
+// 64-bit fingerprint of the file at path, similar images give hashes a few bits apart.
+// rows are streamed and area-averaged into a small grayscale grid on the way,
+// so memory stays at one band of the source
+uint64_t perceptual_hash(const char * path, HashKind kind);
+
+// writes "<path>\t<hash>" for each input as it is done, in no particular order.
+// inputs starting with @ name a file listing one path per line; unreadable files get "error: ..." instead of a hash.
+// files are hashed in jobs on pool, or one after another on the calling thread when it is null
+void hash_files(std::span<const std::string> inputs, HashKind kind, ThreadPool * pool, std::ostream & output);
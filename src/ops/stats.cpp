@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <format>
+#include "ops/stats.hpp"
+#include "format/pixel_array/expanded.hpp"
+#include "util/json.hpp"
+#include "util/parallel.hpp"
+
+namespace {
+    using histogram = std::array<uint64_t, 256>;
+
+    uint32_t rgb_key(uint8_t r, uint8_t g, uint8_t b) {
+        return (uint32_t(r) << 16) | (uint32_t(g) << 8) | b;
+    }
+
+    void finish_channel(ChannelStats & channel, uint64_t total) {
+        uint64_t sum = 0;
+        bool seen = false;
+        for (unsigned int v = 0; v < 256; v++) {
+            uint64_t count = channel.histogram[v];
+            if (count == 0) {
+                continue;
+            }
+            if (!seen) {
+                channel.min = static_cast<uint8_t>(v);
+                seen = true;
+            }
+            channel.max = static_cast<uint8_t>(v);
+            sum += count * v;
+        }
+        channel.mean = total ? static_cast<double>(sum) / static_cast<double>(total) : 0;
+    }
+
+    // palette indices of 1, 2, 4 and 8bpp images; whole bytes of packed rows are counted
+    // as byte values and only split into pixels once, per distinct byte value
+    std::vector<uint64_t> count_indices(BitmapPixelArray * pixels, uint16_t bits_per_pixel, ThreadPool * pool) {
+        unsigned int rows = static_cast<unsigned int>(std::abs(pixels->height()));
+        unsigned int width = pixels->width();
+        size_t row_size = static_cast<size_t>(pixels->row_byte_size());
+        const uint8_t * data = pixels->data();
+
+        unsigned int pixels_per_byte = 8 / bits_per_pixel;
+        unsigned int full_bytes = width / pixels_per_byte;
+        uint8_t mask = static_cast<uint8_t>((1u << bits_per_pixel) - 1u);
+
+        unsigned int bands = band_count(pool, rows, row_size);
+        std::vector<histogram> byte_counts(bands);
+        std::vector<histogram> index_counts(bands);
+
+        for_each_band(pool, rows, bands, [&](unsigned int band, unsigned int begin, unsigned int end) {
+            histogram & bytes = byte_counts[band];
+            histogram & indices = index_counts[band];
+            for (unsigned int r = begin; r < end; r++) {
+                const uint8_t * row = data + r * row_size;
+                for (unsigned int k = 0; k < full_bytes; k++) {
+                    bytes[row[k]]++;
+                }
+                for (unsigned int j = full_bytes * pixels_per_byte; j < width; j++) {
+                    unsigned int shift = (pixels_per_byte - 1 - j % pixels_per_byte) * bits_per_pixel;
+                    indices[(row[j / pixels_per_byte] >> shift) & mask]++;
+                }
+            }
+        });
+
+        std::vector<uint64_t> counts(256, 0);
+        for (unsigned int band = 0; band < bands; band++) {
+            for (unsigned int v = 0; v < 256; v++) {
+                counts[v] += index_counts[band][v];
+                uint64_t c = byte_counts[band][v];
+                if (c == 0) {
+                    continue;
+                }
+                for (unsigned int p = 0; p < pixels_per_byte; p++) {
+                    counts[(v >> (p * bits_per_pixel)) & mask] += c;
+                }
+            }
+        }
+        counts.resize(1u << bits_per_pixel);
+        return counts;
+    }
+
+    // folds per-value counts through a value -> rgb mapping
+    template<typename F>
+    void fold_counts(BitmapStats & stats, const std::vector<uint64_t> & counts, F to_rgb) {
+        std::vector<uint32_t> keys;
+        for (size_t v = 0; v < counts.size(); v++) {
+            if (counts[v] == 0) {
+                continue;
+            }
+            color c = to_rgb(v);
+            for (int ch = 0; ch < 3; ch++) {
+                stats.channels[ch].histogram[c[ch]] += counts[v];
+            }
+            keys.push_back(rgb_key(c[0], c[1], c[2]));
+        }
+        std::sort(keys.begin(), keys.end());
+        stats.unique_colors = static_cast<uint64_t>(std::unique(keys.begin(), keys.end()) - keys.begin());
+    }
+
+    void direct_color_stats(BitmapStats & stats, BitmapPixelArray * pixels, unsigned int bytes_per_pixel, ThreadPool * pool) {
+        unsigned int rows = stats.height;
+        unsigned int width = stats.width;
+        size_t row_size = static_cast<size_t>(pixels->row_byte_size());
+        const uint8_t * data = pixels->data();
+
+        // one bit per 24-bit colour, shared between bands
+        std::vector<uint64_t> seen((1u << 24) / 64, 0);
+
+        unsigned int bands = band_count(pool, rows, row_size);
+        std::vector<std::array<histogram, 4>> partial(bands);
+
+        for_each_band(pool, rows, bands, [&](unsigned int band, unsigned int begin, unsigned int end) {
+            auto & hist = partial[band];
+            for (unsigned int r = begin; r < end; r++) {
+                const uint8_t * p = data + r * row_size;
+                for (unsigned int j = 0; j < width; j++, p += bytes_per_pixel) {
+                    hist[0][p[2]]++;
+                    hist[1][p[1]]++;
+                    hist[2][p[0]]++;
+                    if (bytes_per_pixel == 4) {
+                        hist[3][p[3]]++;
+                    }
+
+                    uint32_t key = rgb_key(p[2], p[1], p[0]);
+                    uint64_t bit = uint64_t(1) << (key % 64);
+                    std::atomic_ref<uint64_t> word(seen[key / 64]);
+                    if ((word.load(std::memory_order_relaxed) & bit) == 0) {
+                        word.fetch_or(bit, std::memory_order_relaxed);
+                    }
+                }
+            }
+        });
+
+        for (auto & hist : partial) {
+            for (size_t ch = 0; ch < stats.channels.size(); ch++) {
+                for (unsigned int v = 0; v < 256; v++) {
+                    stats.channels[ch].histogram[v] += hist[ch][v];
+                }
+            }
+        }
+
+        stats.unique_colors = 0;
+        for (uint64_t word : seen) {
+            stats.unique_colors += static_cast<uint64_t>(__builtin_popcountll(word));
+        }
+    }
+
+    std::vector<uint64_t> count_16bit(BitmapPixelArray * pixels, ThreadPool * pool) {
+        unsigned int rows = static_cast<unsigned int>(std::abs(pixels->height()));
+        unsigned int width = pixels->width();
+        size_t row_size = static_cast<size_t>(pixels->row_byte_size());
+        const uint8_t * data = pixels->data();
+
+        unsigned int bands = band_count(pool, rows, row_size);
+        std::vector<std::vector<uint64_t>> partial(bands, std::vector<uint64_t>(1u << 16, 0));
+
+        for_each_band(pool, rows, bands, [&](unsigned int band, unsigned int begin, unsigned int end) {
+            auto & counts = partial[band];
+            for (unsigned int r = begin; r < end; r++) {
+                const uint8_t * p = data + r * row_size;
+                for (unsigned int j = 0; j < width; j++) {
+                    counts[p[2 * j] | (p[2 * j + 1] << 8)]++;
+                }
+            }
+        });
+
+        for (unsigned int band = 1; band < bands; band++) {
+            for (size_t v = 0; v < partial[0].size(); v++) {
+                partial[0][v] += partial[band][v];
+            }
+        }
+        return std::move(partial[0]);
+    }
+}
+
+BitmapStats compute_stats(Bitmap & bmp, ThreadPool * pool) {
+    BitmapPixelArray * pixels = bmp.pixels;
+    BitmapStats stats;
+    stats.width = pixels->width();
+    stats.height = static_cast<unsigned int>(std::abs(pixels->height()));
+    stats.bits_per_pixel = bmp.header.bits_per_pixel;
+    stats.pixel_count = uint64_t(stats.width) * stats.height;
+    stats.unique_colors = 0;
+    stats.channels.resize(stats.bits_per_pixel == 32 ? 4 : 3);
+
+    if (stats.bits_per_pixel <= 8) {
+        stats.index_histogram = count_indices(pixels, stats.bits_per_pixel, pool);
+        fold_counts(stats, stats.index_histogram, [&](size_t idx) {
+            return palette_color(bmp.color_table, static_cast<unsigned int>(idx));
+        });
+    } else if (stats.bits_per_pixel == 16) {
+        auto * expanded = static_cast<ExpandedBitmapPixelArray *>(pixels);
+        fold_counts(stats, count_16bit(pixels, pool), [&](size_t v) {
+            return expanded->color_from_16bit(static_cast<uint16_t>(v));
+        });
+    } else {
+        direct_color_stats(stats, pixels, stats.bits_per_pixel / 8, pool);
+    }
+
+    for (auto & channel : stats.channels) {
+        finish_channel(channel, stats.pixel_count);
+    }
+    return stats;
+}
+
+std::string stats_json(const BitmapStats & stats) {
+    static constexpr const char * channel_names[] = {"red", "green", "blue", "alpha"};
+
+    auto join = [](const auto & values) {
+        std::string s;
+        for (auto v : values) {
+            if (!s.empty()) {
+                s += ',';
+            }
+            s += std::format("{}", v);
+        }
+        return s;
+    };
+
+    std::string channels;
+    for (size_t ch = 0; ch < stats.channels.size(); ch++) {
+        const ChannelStats & c = stats.channels[ch];
+        if (!channels.empty()) {
+            channels += ',';
+        }
+        channels += std::format("{}:{{\"min\":{},\"max\":{},\"mean\":{:.4f},\"histogram\":[{}]}}",
+            json_escape(channel_names[ch]), c.min, c.max, c.mean, join(c.histogram));
+    }
+
+    std::string json = std::format("{{\"width\":{},\"height\":{},\"bits_per_pixel\":{},\"pixels\":{},\"unique_colors\":{},\"channels\":{{{}}}",
+        stats.width, stats.height, stats.bits_per_pixel, stats.pixel_count, stats.unique_colors, channels);
+    if (!stats.index_histogram.empty()) {
+        json += std::format(",\"index_histogram\":[{}]", join(stats.index_histogram));
+    }
+    json += '}';
+    return json;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "format/bmp.hpp"
+#include "util/thread_pool.hpp"
+
+struct ChannelStats {
+    std::array<uint64_t, 256> histogram {};
+    uint8_t min = 0;
+    uint8_t max = 0;
+    double mean = 0;
+};
+
+struct BitmapStats {
+    unsigned int width;
+    unsigned int height;
+    uint16_t bits_per_pixel;
+    uint64_t pixel_count;
+    uint64_t unique_colors; // distinct rgb triples, alpha is ignored
+    std::vector<ChannelStats> channels; // r, g, b and a for 32bpp
+    std::vector<uint64_t> index_histogram; // only for indexed formats
+};
+
+// one pass over the raw pixel bytes, indexed formats are counted per palette index
+// and folded through the color table afterwards. bands of rows are counted on pool when there is one
+BitmapStats compute_stats(Bitmap & bmp, ThreadPool * pool);
+
+std::string stats_json(const BitmapStats & stats);
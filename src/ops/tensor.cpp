@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include "ops/tensor.hpp"
+#include "exceptions.hpp"
+
+namespace {
+    // source position and weight of the right neighbour for each output column (or row)
+    struct Sample {
+        unsigned int index;
+        float weight;
+    };
+
+    std::vector<Sample> samples(unsigned int source, unsigned int output) {
+        std::vector<Sample> result(output);
+        float scale = static_cast<float>(source) / static_cast<float>(output);
+        for (unsigned int i = 0; i < output; i++) {
+            float x = std::clamp((static_cast<float>(i) + 0.5f) * scale - 0.5f, 0.0f, static_cast<float>(source - 1));
+            unsigned int index = std::min(static_cast<unsigned int>(x), source - 1);
+            result[i] = Sample {index, index + 1 < source ? x - static_cast<float>(index) : 0.0f};
+        }
+        return result;
+    }
+
+    // bands read from the file at once
+    constexpr size_t band_bytes = 1024 * 1024;
+}
+
+TensorDecoder::TensorDecoder(const char * path, TensorSpec spec) : reader(path), spec(spec) {
+    if (spec.channels != 3 && spec.channels != 4) {
+        throw invalid_usage();
+    }
+
+    vec2<int> from {0, 0};
+    vec2<int> to {static_cast<int>(reader.width) - 1, static_cast<int>(reader.rows) - 1};
+    if (spec.region) {
+        auto [ra, rb] = *spec.region;
+        if (ra[0] < 0 || ra[1] < 0 || rb[0] > to[0] || rb[1] > to[1] || ra[0] > rb[0] || ra[1] > rb[1]) {
+            throw invalid_coordinates(ra, rb);
+        }
+        from = ra;
+        to = rb;
+    }
+    a = {static_cast<unsigned int>(from[0]), static_cast<unsigned int>(from[1])};
+    b = {static_cast<unsigned int>(to[0]), static_cast<unsigned int>(to[1])};
+    w = spec.width ? spec.width : b[0] - a[0] + 1;
+    h = spec.height ? spec.height : b[1] - a[1] + 1;
+
+    for (auto & r : rows) {
+        r.resize(reader.width);
+    }
+    band_rows = static_cast<unsigned int>(std::max<size_t>(1, band_bytes / get_row_size(reader.bitmap.header.bits_per_pixel, reader.width)));
+    reader.seek(a[1]);
+}
+
+size_t TensorDecoder::byte_size() const {
+    size_t element = spec.type == TensorType::float32 ? sizeof(float) : sizeof(uint8_t);
+    return size_t(spec.channels) * h * w * element;
+}
+
+const color * TensorDecoder::row(unsigned int i) {
+    // consecutive rows differ in parity, so each keeps its own slot
+    unsigned int slot = i % 2;
+    if (row_index[slot] != static_cast<long>(i)) {
+        // rows skipped by a downscale are never read
+        if (reader.bitmap.pixels == nullptr || i >= reader.band_start() + static_cast<unsigned int>(abs(reader.bitmap.pixels->height()))) {
+            reader.seek(i);
+            reader.read_band(std::min(band_rows, b[1] + 1 - i));
+        }
+        reader.bitmap.pixels->get_row(i - reader.band_start(), rows[slot].data());
+        row_index[slot] = i;
+    }
+    return rows[slot].data();
+}
+
+template<typename T>
+void TensorDecoder::decode_into(T * out) {
+    unsigned int region_w = b[0] - a[0] + 1;
+    unsigned int region_h = b[1] - a[1] + 1;
+    size_t plane = size_t(w) * h;
+
+    std::array<float, 4> scale, offset;
+    for (unsigned int c = 0; c < 4; c++) {
+        scale[c] = 1.0f / (255.0f * spec.stddev[c]);
+        offset[c] = -spec.mean[c] / spec.stddev[c];
+    }
+    auto store = [&](T * p, unsigned int c, float v) {
+        if constexpr (std::is_same_v<T, float>) {
+            *p = v * scale[c] + offset[c];
+        } else {
+            *p = static_cast<uint8_t>(v + 0.5f);
+        }
+    };
+
+    if (region_w == w && region_h == h) {
+        for (unsigned int y = 0; y < h; y++) {
+            const color * source = row(a[1] + y) + a[0];
+            for (unsigned int c = 0; c < spec.channels; c++) {
+                T * p = out + c * plane + size_t(y) * w;
+                for (unsigned int x = 0; x < w; x++) {
+                    store(p + x, c, source[x][c]);
+                }
+            }
+        }
+        return;
+    }
+
+    std::vector<Sample> columns = samples(region_w, w);
+    std::vector<Sample> lines = samples(region_h, h);
+    for (unsigned int y = 0; y < h; y++) {
+        const color * upper = row(a[1] + lines[y].index) + a[0];
+        const color * lower = lines[y].weight > 0 ? row(a[1] + lines[y].index + 1) + a[0] : upper;
+        float fy = lines[y].weight;
+        for (unsigned int c = 0; c < spec.channels; c++) {
+            T * p = out + c * plane + size_t(y) * w;
+            for (unsigned int x = 0; x < w; x++) {
+                unsigned int left = columns[x].index;
+                unsigned int right = columns[x].weight > 0 ? left + 1 : left;
+                float fx = columns[x].weight;
+                float top = upper[left][c] + fx * (upper[right][c] - upper[left][c]);
+                float bottom = lower[left][c] + fx * (lower[right][c] - lower[left][c]);
+                store(p + x, c, top + fy * (bottom - top));
+            }
+        }
+    }
+}
+
+void TensorDecoder::decode(void * out) {
+    if (spec.type == TensorType::float32) {
+        decode_into(static_cast<float *>(out));
+    } else {
+        decode_into(static_cast<uint8_t *>(out));
+    }
+}
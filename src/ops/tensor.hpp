@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "format/row_reader.hpp"
+
+enum class TensorType { uint8, float32 };
+
+struct TensorSpec {
+    TensorType type = TensorType::float32;
+    // r, g, b and optionally a
+    unsigned int channels = 3;
+    // inclusive corners of the source region, the whole image when empty
+    std::optional<std::pair<vec2<int>, vec2<int>>> region;
+    // output size, the region's size when 0; other sizes are resampled bilinearly
+    unsigned int width = 0;
+    unsigned int height = 0;
+    // float32 values are (v / 255 - mean) / stddev per channel, uint8 values are stored as they are
+    std::array<float, 4> mean {0, 0, 0, 0};
+    std::array<float, 4> stddev {1, 1, 1, 1};
+};
+
+// decodes a file straight into a planar channels x height x width tensor with rows top-down,
+// reading only the rows of the region and never holding more than a band of the source
+class TensorDecoder {
+    BitmapRowReader reader;
+    TensorSpec spec;
+    vec2<unsigned int> a, b;
+    unsigned int w, h;
+
+    // decoded source rows, two are enough since output rows only move down
+    std::array<std::vector<color>, 2> rows;
+    std::array<long, 2> row_index {-1, -1};
+    unsigned int band_rows = 0;
+
+    const color * row(unsigned int i);
+
+    template<typename T>
+    void decode_into(T * out);
+
+public:
+    TensorDecoder(const char * path, TensorSpec spec);
+
+    unsigned int width() const { return w; }
+    unsigned int height() const { return h; }
+    // size of the buffer decode fills
+    size_t byte_size() const;
+
+    void decode(void * out);
+};
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <vector>
+#include "ops/tile.hpp"
+#include "format/row_reader.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+    // tiles of the first band_rows rows of band, which is band_index tiles down
+    void write_band_tiles(Bitmap & band, unsigned int band_rows, unsigned int band_index, unsigned int tile_size, const fs::path & level_dir) {
+        unsigned int width = band.pixels->width();
+        for (unsigned int x = 0, column = 0; x < width; x += tile_size, column++) {
+            vec2<int> a {static_cast<int>(x), 0};
+            vec2<int> b {static_cast<int>(std::min(x + tile_size, width) - 1), static_cast<int>(band_rows - 1)};
+            Bitmap tile(band, a, b);
+            tile.write((level_dir / std::format("{}_{}.bmp", column, band_index)).c_str());
+        }
+    }
+
+    // one downsampled level, fed rows of the level above as they stream past
+    class PyramidLevel {
+        unsigned int source_width;
+        unsigned int width;
+        unsigned int tile_size;
+        fs::path dir;
+
+        std::vector<color> pending;
+        bool has_pending = false;
+
+        Bitmap band; // top-down, one tile high
+        unsigned int band_rows = 0;
+        unsigned int band_index = 0;
+
+        std::unique_ptr<PyramidLevel> next;
+
+        void add_row(const color * row) {
+            uint8_t * p = band.pixels->data() + size_t(band_rows) * band.pixels->row_byte_size();
+            unsigned int bytes_per_pixel = band.header.bits_per_pixel / 8;
+            for (unsigned int j = 0; j < width; j++, p += bytes_per_pixel) {
+                p[0] = row[j][2];
+                p[1] = row[j][1];
+                p[2] = row[j][0];
+                if (bytes_per_pixel == 4) {
+                    p[3] = row[j][3];
+                }
+            }
+            if (next) {
+                next->push(row);
+            }
+            if (++band_rows == static_cast<unsigned int>(abs(band.pixels->height()))) {
+                flush();
+            }
+        }
+
+        void flush() {
+            if (band_rows > 0) {
+                write_band_tiles(band, band_rows, band_index++, tile_size, dir);
+                band_rows = 0;
+            }
+        }
+
+        // 2x2 box filter, the last column or row is repeated for odd sizes
+        void downsample(const color * upper, const color * lower) {
+            std::vector<color> row(width);
+            for (unsigned int j = 0; j < width; j++) {
+                unsigned int left = 2 * j;
+                unsigned int right = std::min(left + 1, source_width - 1);
+                for (int ch = 0; ch < 4; ch++) {
+                    unsigned int sum = upper[left][ch] + upper[right][ch] + lower[left][ch] + lower[right][ch];
+                    row[j][ch] = static_cast<uint8_t>((sum + 2) / 4);
+                }
+            }
+            add_row(row.data());
+        }
+
+    public:
+        PyramidLevel(unsigned int level, unsigned int source_width, unsigned int source_rows, uint16_t bits_per_pixel,
+                     unsigned int tile_size, const fs::path & output_dir)
+            : source_width(source_width)
+            , width((source_width + 1) / 2)
+            , tile_size(tile_size)
+            , dir(output_dir / std::format("{}", level))
+            , pending(source_width)
+            , band(bits_per_pixel, width, -static_cast<int>(std::min(tile_size, (source_rows + 1) / 2))) {
+            fs::create_directories(dir);
+            unsigned int rows = (source_rows + 1) / 2;
+            if (width > tile_size || rows > tile_size) {
+                next = std::make_unique<PyramidLevel>(level + 1, width, rows, bits_per_pixel, tile_size, output_dir);
+            }
+        }
+
+        void push(const color * row) {
+            if (!has_pending) {
+                std::copy(row, row + source_width, pending.begin());
+                has_pending = true;
+                return;
+            }
+            has_pending = false;
+            downsample(pending.data(), row);
+        }
+
+        void finish() {
+            if (has_pending) {
+                has_pending = false;
+                downsample(pending.data(), pending.data());
+            }
+            flush();
+            if (next) {
+                next->finish();
+            }
+        }
+    };
+}
+
+void write_tiles(const char * input, const char * output_dir, unsigned int tile_size, bool pyramid) {
+    BitmapRowReader reader(input);
+    fs::path level_dir = fs::path(output_dir) / "0";
+    fs::create_directories(level_dir);
+
+    std::unique_ptr<PyramidLevel> half;
+    if (pyramid && (reader.width > tile_size || reader.rows > tile_size)) {
+        uint16_t bits_per_pixel = reader.bitmap.header.bits_per_pixel == 32 ? 32 : 24;
+        half = std::make_unique<PyramidLevel>(1, reader.width, reader.rows, bits_per_pixel, tile_size, output_dir);
+    }
+
+    std::vector<color> row(reader.width);
+    unsigned int band_index = 0;
+    while (unsigned int band_rows = reader.read_band(tile_size)) {
+        write_band_tiles(reader.bitmap, band_rows, band_index++, tile_size, level_dir);
+        if (half) {
+            for (unsigned int i = 0; i < band_rows; i++) {
+                reader.bitmap.pixels->get_row(i, row.data());
+                half->push(row.data());
+            }
+        }
+    }
+    if (half) {
+        half->finish();
+    }
+}
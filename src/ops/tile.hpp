@@ -0,0 +1,6 @@
+#pragma once
+
+// splits input into tile_size square tiles written as <output_dir>/<level>/<column>_<row>.bmp,
+// reading the source once in bands of tile_size rows. level 0 is the source in its own format;
+// with pyramid every further level halves the previous one until it fits a single tile
+void write_tiles(const char * input, const char * output_dir, unsigned int tile_size, bool pyramid);
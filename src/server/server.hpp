@@ -0,0 +1,42 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "command.hpp"
+#include "util/thread_pool.hpp"
+
+// line-oriented job server over a unix domain socket.
+// each request line is "<id> <command> <args...>" with the same commands as the cli,
+// each response is one json line tagged with the request id.
+// "<id> +<length> <command> <args...>" is followed by length raw bytes of a bitmap
+// that input arguments "-" read; a bitmap written to an output argument "-" follows
+// the response line, which gives its size in "bytes".
+// "<id> stats" reports queue depth, latency histogram and throughput.
+class Server {
+    std::string socket_path;
+    int listen_fd = -1;
+    ThreadPool pool;
+    CommandOptions options;
+
+    std::chrono::steady_clock::time_point started;
+    std::atomic<uint64_t> completed = 0;
+    std::atomic<uint64_t> failed = 0;
+    // bucket k counts jobs that took less than 2^k microseconds
+    std::array<std::atomic<uint64_t>, 32> latency_histogram {};
+
+    void serve_connection(int fd);
+    void record_latency(std::chrono::steady_clock::duration latency);
+    std::string stats_json();
+
+public:
+    Server(const char * socket_path, unsigned int threads = 0, CommandOptions options = {});
+    ~Server();
+
+    Server(const Server &) = delete;
+    Server & operator=(const Server &) = delete;
+
+    void run();
+};
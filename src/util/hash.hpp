@@ -0,0 +1,116 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// streaming XXH64, matches the reference implementation output
+class xxhash64 {
+    static constexpr uint64_t prime1 = 0x9E3779B185EBCA87ull;
+    static constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+    static constexpr uint64_t prime3 = 0x165667B19E3779F9ull;
+    static constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ull;
+    static constexpr uint64_t prime5 = 0x27D4EB2F165667C5ull;
+
+    uint64_t seed;
+    uint64_t acc[4];
+    uint8_t buffer[32];
+    size_t buffered = 0;
+    uint64_t total = 0;
+
+    static uint64_t read64(const uint8_t * p) { uint64_t v; std::memcpy(&v, p, 8); return v; }
+    static uint32_t read32(const uint8_t * p) { uint32_t v; std::memcpy(&v, p, 4); return v; }
+
+    static uint64_t round(uint64_t acc, uint64_t input) {
+        acc += input * prime2;
+        acc = std::rotl(acc, 31);
+        return acc * prime1;
+    }
+
+    static uint64_t merge_round(uint64_t acc, uint64_t value) {
+        acc ^= round(0, value);
+        return acc * prime1 + prime4;
+    }
+
+    void consume_stripe(const uint8_t * p) {
+        acc[0] = round(acc[0], read64(p));
+        acc[1] = round(acc[1], read64(p + 8));
+        acc[2] = round(acc[2], read64(p + 16));
+        acc[3] = round(acc[3], read64(p + 24));
+    }
+
+public:
+    xxhash64(uint64_t seed = 0) : seed(seed) {
+        acc[0] = seed + prime1 + prime2;
+        acc[1] = seed + prime2;
+        acc[2] = seed;
+        acc[3] = seed - prime1;
+    }
+
+    void update(const void * data, size_t size) {
+        auto * p = static_cast<const uint8_t *>(data);
+        total += size;
+
+        if (buffered + size < 32) {
+            std::memcpy(buffer + buffered, p, size);
+            buffered += size;
+            return;
+        }
+        if (buffered > 0) {
+            size_t fill = 32 - buffered;
+            std::memcpy(buffer + buffered, p, fill);
+            consume_stripe(buffer);
+            p += fill;
+            size -= fill;
+            buffered = 0;
+        }
+        for (; size >= 32; p += 32, size -= 32) {
+            consume_stripe(p);
+        }
+        std::memcpy(buffer, p, size);
+        buffered = size;
+    }
+
+    void update(std::string_view s) {
+        update(s.data(), s.size());
+    }
+
+    uint64_t digest() const {
+        uint64_t h;
+        if (total >= 32) {
+            h = std::rotl(acc[0], 1) + std::rotl(acc[1], 7) + std::rotl(acc[2], 12) + std::rotl(acc[3], 18);
+            for (uint64_t a : acc) {
+                h = merge_round(h, a);
+            }
+        } else {
+            h = seed + prime5;
+        }
+        h += total;
+
+        const uint8_t * p = buffer;
+        size_t left = buffered;
+        for (; left >= 8; p += 8, left -= 8) {
+            h ^= round(0, read64(p));
+            h = std::rotl(h, 27) * prime1 + prime4;
+        }
+        if (left >= 4) {
+            h ^= uint64_t(read32(p)) * prime1;
+            h = std::rotl(h, 23) * prime2 + prime3;
+            p += 4;
+            left -= 4;
+        }
+        for (; left > 0; p++, left--) {
+            h ^= *p * prime5;
+            h = std::rotl(h, 11) * prime1;
+        }
+
+        h ^= h >> 33;
+        h *= prime2;
+        h ^= h >> 29;
+        h *= prime3;
+        h ^= h >> 32;
+        return h;
+    }
+};
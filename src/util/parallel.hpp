@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <latch>
+#include <utility>
+#include <vector>
+#include "util/thread_pool.hpp"
+
+// number of row bands worth running as separate jobs on pool, 1 without a pool.
+// bands smaller than ~256 KiB cost more to hand out than they save
+inline unsigned int band_count(ThreadPool * pool, unsigned int rows, size_t row_bytes) {
+    if (pool == nullptr) {
+        return 1;
+    }
+    constexpr size_t min_band_bytes = 256 * 1024;
+    size_t by_size = rows * row_bytes / min_band_bytes;
+    return static_cast<unsigned int>(std::clamp<size_t>(std::min(by_size, pool->size()), 1, std::max(1u, rows)));
+}
+
+// calls f(band, begin, end) for `bands` contiguous slices of [0, rows). the first band runs on the calling thread,
+// the others are jobs on pool, so the caller must not be one of pool's own workers; without a pool they run in turn.
+// an exception from any band is rethrown here once every band has finished
+template<typename F>
+void for_each_band(ThreadPool * pool, unsigned int rows, unsigned int bands, F f) {
+    bands = std::max(1u, bands);
+    unsigned int step = (rows + bands - 1) / bands;
+    auto bounds = [&](unsigned int band) {
+        unsigned int begin = std::min(rows, band * step);
+        return std::pair {begin, std::min(rows, begin + step)};
+    };
+    if (pool == nullptr || bands == 1) {
+        for (unsigned int band = 0; band < bands; band++) {
+            auto [begin, end] = bounds(band);
+            f(band, begin, end);
+        }
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(bands);
+    std::latch done(bands - 1);
+    for (unsigned int band = 1; band < bands; band++) {
+        auto [begin, end] = bounds(band);
+        pool->submit([&f, &errors, &done, band, begin, end] {
+            try {
+                f(band, begin, end);
+            } catch (...) {
+                errors[band] = std::current_exception();
+            }
+            done.count_down();
+        });
+    }
+    try {
+        auto [begin, end] = bounds(0);
+        f(0u, begin, end);
+    } catch (...) {
+        errors[0] = std::current_exception();
+    }
+    done.wait();
+
+    for (const auto & error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+// calls f(begin, end) over row bands sized by band_count
+template<typename F>
+void parallel_rows(ThreadPool * pool, unsigned int rows, size_t row_bytes, F f) {
+    for_each_band(pool, rows, band_count(pool, rows, row_bytes), [&f](unsigned int, unsigned int begin, unsigned int end) {
+        f(begin, end);
+    });
+}
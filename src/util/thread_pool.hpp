@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+    unsigned int threads;
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable job_available;
+    std::condition_variable idle;
+    size_t active = 0;
+    bool stopping = false;
+
+    void work() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock lock(mutex);
+                job_available.wait(lock, [&] { return stopping || !jobs.empty(); });
+                if (jobs.empty()) {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop_front();
+                active++;
+            }
+
+            job();
+
+            std::lock_guard lock(mutex);
+            active--;
+            if (active == 0 && jobs.empty()) {
+                idle.notify_all();
+            }
+        }
+    }
+
+public:
+    // 0 means one worker per core. workers start with the first job,
+    // so a pool that is never used costs no threads
+    ThreadPool(unsigned int threads = 0) : threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        job_available.notify_all();
+        for (auto & worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool & operator=(const ThreadPool &) = delete;
+
+    void submit(std::function<void()> job) {
+        {
+            std::lock_guard lock(mutex);
+            if (workers.empty()) {
+                for (unsigned int i = 0; i < threads; i++) {
+                    workers.emplace_back([this] { work(); });
+                }
+            }
+            jobs.push_back(std::move(job));
+        }
+        job_available.notify_one();
+    }
+
+    // blocks until every submitted job has finished
+    void wait() {
+        std::unique_lock lock(mutex);
+        idle.wait(lock, [&] { return active == 0 && jobs.empty(); });
+    }
+
+    size_t queue_size() {
+        std::lock_guard lock(mutex);
+        return jobs.size();
+    }
+
+    size_t size() {
+        return threads;
+    }
+};